@@ -87,6 +87,22 @@ struct AlphaString : FunctorLike<C>, FunctorLike<CPtrBox>
 		return {alphabet, std::move(new_string)};
 	}
 
+	/*
+	 * A string of chars that were already looked up in the alphabet, e.g. by
+	 * a lexer.
+	 */
+	static AlphaString<C, CPtrBox>
+	fromChars(shared_ptr<AlphabetLike<C, CPtrBox>> alphabet,
+	          std::vector<CPtrBox>&& chars)
+	{
+		for (auto c : chars)
+			if (!c || alphabet->findChar(*c) != c)
+				throw std::invalid_argument(
+				    "Attempted to build a string of chars not in alphabet.");
+
+		return {alphabet, std::move(chars)};
+	}
+
 private:
 	AlphaString(shared_ptr<AlphabetLike<C, CPtrBox>> alphabet,
 	            const std::vector<CPtrBox>&& string)
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <memory>
 #include <sstream>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace context_free {
@@ -44,6 +47,45 @@ inline std::ostream& operator<<(std::ostream& out, LetterChar const& c)
 	return out;
 }
 
+inline size_t hashChar(LetterChar const& c)
+{
+	return std::hash<char>{}(c.value);
+}
+
+/*
+ * A terminal standing for a whole token, such as "identifier" or "while",
+ * so that words can be read token by token instead of char by char.
+ */
+struct TokenChar : Char
+{
+	const std::string name;
+
+	explicit TokenChar(std::string name) : name(std::move(name)) {}
+
+	void print(std::ostream& out) const override { out << '<' << name << '>'; }
+
+	friend bool operator==(TokenChar const& a, TokenChar const& b)
+	{
+		return a.name == b.name;
+	}
+};
+
+inline bool operator<(TokenChar const& a, TokenChar const& b)
+{
+	return a.name < b.name;
+}
+
+inline std::ostream& operator<<(std::ostream& out, TokenChar const& c)
+{
+	c.print(out);
+	return out;
+}
+
+inline size_t hashChar(TokenChar const& c)
+{
+	return std::hash<std::string>{}(c.name);
+}
+
 template <typename T> struct FunctorLike
 {
 	virtual bool all_of(std::function<bool(T const&)> const&) const = 0;
@@ -88,26 +130,50 @@ std::vector<unique_ptr<C>> stringToPtrVec(std::string const& string)
 	return vector;
 }
 
+inline std::vector<unique_ptr<TokenChar>>
+namesToPtrVec(std::vector<std::string> const& names)
+{
+	std::vector<unique_ptr<TokenChar>> vector;
+	vector.reserve(names.size());
+	for (auto const& name : names)
+		vector.push_back(std::make_unique<TokenChar>(name));
+	return vector;
+}
+
 template <typename C> class Alphabet : public AlphabetLike<C, const C*>
 {
 	/*
-	 * An immutable object representing a finite alphabet
+	 * An immutable object representing a finite alphabet. Chars are found
+	 * by hash, through the hashChar() of their type, so that alphabets of
+	 * named symbols can grow to hundreds of thousands of chars.
 	 */
 	using C_ptr_vec = std::vector<const C*>;
 
+	struct PointeeHash
+	{
+		size_t operator()(const C* c) const { return hashChar(*c); }
+	};
+
+	struct PointeeEqual
+	{
+		bool operator()(const C* a, const C* b) const { return *a == *b; }
+	};
+
+	using Index = std::unordered_set<const C*, PointeeHash, PointeeEqual>;
+
+	// Declared before chars, which rawifyChars() fills it along with.
+	Index index{};
 	const C_ptr_vec chars{};
 
 	static std::shared_ptr<Alphabet<C>> emptyAlphabet;
 
-	static C_ptr_vec rawifyChars(std::vector<unique_ptr<C>>&& chars)
+	static C_ptr_vec rawifyChars(std::vector<unique_ptr<C>>&& chars, Index& index)
 	{
 		C_ptr_vec rawified{};
 		rawified.reserve(chars.size());
+		index.reserve(chars.size());
 		for (unique_ptr<C>& c : chars) {
-			if (std::find_if(std::begin(rawified), std::end(rawified),
-			                 [& c = *c](const C* b) { return c == *b; }) ==
-			    std::end(rawified))
-				rawified.push_back(c.release());
+			if (index.insert(c.get()).second) rawified.push_back(c.release());
 		}
 		return rawified;
 	}
@@ -118,7 +184,7 @@ template <typename C> class Alphabet : public AlphabetLike<C, const C*>
 
 public:
 	Alphabet(std::vector<unique_ptr<C>>&& chars)
-	    : chars(rawifyChars(std::move(chars)))
+	    : chars(rawifyChars(std::move(chars), index))
 	{
 		if (chars.size() == 0)
 			throw std::invalid_argument(
@@ -144,10 +210,9 @@ public:
 
 	const C* findChar(C const& c) const override
 	{
-		auto what_found =
-		    std::find_if(begin(), end(), [c](const C* x) { return *x == c; });
+		auto what_found = index.find(&c);
 
-		return what_found == end() ? nullptr : *what_found;
+		return what_found == index.end() ? nullptr : *what_found;
 	}
 
 	Alphabet operator+(Alphabet const&) const
@@ -24,15 +24,10 @@ template <typename C1, typename C2> struct CharUnion
 		return value == other.value;
 	}
 
+	// True if the union holds a char, like a non-null pointer.
 	operator bool() const
 	{
-		bool isEmpty = false;
-		std::visit(
-		    [&isEmpty](auto x) {
-			    if (!x) isEmpty = true;
-		    },
-		    value);
-		return isEmpty;
+		return std::visit([](auto x) { return x != nullptr; }, value);
 	}
 
 	template <typename P> auto visit(P predicate) const
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class AmbiguityDetector
+{
+	/*
+	 * Counts the derivations of every word of the language up to a length
+	 * bound, to find the ambiguous ones. Counts are those of the source
+	 * grammar (see CNFGrammar) and saturate at 2^64 - 1.
+	 *
+	 * Words are visited depth first, as paths in the trie of their prefixes.
+	 * The CYK chart is kept by columns: column j holds the cells of every
+	 * span [i, j) and only depends on the first j chars, so it is computed
+	 * once per prefix and shared by all words that extend the prefix. Along
+	 * with the derivations, every cell holds the nonterminals that derive
+	 * its span followed by more, as a bit set; a prefix that no word of the
+	 * language starts with is not extended.
+	 */
+public:
+	using Count = std::uint64_t;
+
+	/*
+	 * A source rule deriving a span, and how the span splits up among the
+	 * symbols of its right-hand side. Symbols that derive eps get no part of
+	 * their own, so the parts around them may run together, and a rule
+	 * applied above unit rules only gets the whole span; see
+	 * CNFGrammar::Origin.
+	 */
+	struct Alternative
+	{
+		std::uint32_t rule;       // in grammar.sourceRules
+		std::vector<size_t> cuts; // part p is [cuts[p], cuts[p + 1])
+		Count derivations;
+	};
+
+	/*
+	 * Where the derivations of a word part ways: a nonterminal deriving the
+	 * span [begin, end) in more than one way, by different source rules or
+	 * split points, or by one of them in several ways below it that do not
+	 * show in a span of their own, such as different eps-derivations.
+	 */
+	struct Explanation
+	{
+		Symbol nonterminal;
+		size_t begin, end;
+		std::vector<Alternative> alternatives;
+	};
+
+	struct AmbiguousWord
+	{
+		std::vector<Symbol> word;
+		Count derivations;
+		Explanation explanation;
+	};
+
+	const CNFGrammar& grammar;
+
+private:
+	struct Use
+	{
+		Symbol from, other;
+		std::uint32_t rule;
+	};
+
+	std::vector<std::vector<Use>> byLeft{};
+	std::vector<std::vector<std::uint32_t>> byTerminal{};
+
+	// Bit sets of nonterminals, one bit each.
+	using Bits = std::vector<std::uint64_t>;
+	const size_t words;
+
+	// leftCorners[B] holds every A with A =>* B..., B itself included.
+	std::vector<Bits> leftCorners{};
+
+	static bool test(Bits const& bits, Symbol A)
+	{
+		return bits[A / 64] >> (A % 64) & 1;
+	}
+
+	struct Cell
+	{
+		// A =>* the span, sorted by A.
+		std::vector<std::pair<Symbol, Count>> derived{};
+		// A =>* the span w for some w.
+		Bits prefixed{};
+	};
+
+	// columns[j][i] is the cell of [i, j) for the current prefix.
+	std::vector<std::vector<Cell>> columns{};
+	std::vector<Symbol> prefix{};
+
+	// Scratch, by nonterminal.
+	std::vector<Count> sums{}, rightCounts{};
+	std::vector<Symbol> touched{};
+
+	Count derivedIn(Cell const& cell, Symbol A) const
+	{
+		auto found = std::lower_bound(
+		    cell.derived.begin(), cell.derived.end(), std::make_pair(A, Count{0}));
+		return found != cell.derived.end() && found->first == A ? found->second : 0;
+	}
+
+	/*
+	 * Fills the column of prefix[0, j) from the ones before it.
+	 */
+	void fillColumn(size_t j)
+	{
+		auto& column = columns[j];
+		column.resize(j);
+
+		for (size_t i = j; i-- > 0;) {
+			Cell& cell = column[i];
+
+			auto count = [this](Symbol A, Count c) {
+				if (!sums[A]) touched.push_back(A);
+				sums[A] = saturatingAdd(sums[A], c);
+			};
+
+			if (i + 1 == j)
+				for (std::uint32_t r : byTerminal[prefix[i]])
+					count(grammar.terminalRules[r].from,
+					      grammar.terminalRules[r].multiplicity);
+
+			for (size_t k = i + 1; k < j; ++k) {
+				auto const& rightCell = column[k].derived;
+				if (rightCell.empty()) continue;
+				for (auto const& [C, c] : rightCell)
+					rightCounts[C] = c;
+				for (auto const& [B, b] : columns[k][i].derived)
+					for (auto const& use : byLeft[B])
+						if (Count c = rightCounts[use.other])
+							count(use.from,
+							      saturatingMul(saturatingMul(b, c),
+							                    grammar.binaryRules[use.rule].multiplicity));
+				for (auto const& [C, c] : rightCell)
+					rightCounts[C] = 0;
+			}
+			cell.derived.clear();
+			std::sort(touched.begin(), touched.end());
+			for (Symbol A : touched) {
+				cell.derived.emplace_back(A, sums[A]);
+				sums[A] = 0;
+			}
+			touched.clear();
+
+			// Whatever derives the span prefixes it, and so does A -> BC if
+			// B derives a part of it and C prefixes the rest; then so do
+			// their left corners.
+			Bits& prefixed = cell.prefixed;
+			prefixed.assign(words, 0);
+			auto reach = [&prefixed, this](Symbol A) {
+				if (test(prefixed, A)) return;
+				for (size_t w = 0; w < words; ++w)
+					prefixed[w] |= leftCorners[A][w];
+			};
+
+			for (auto const& entry : cell.derived)
+				reach(entry.first);
+			for (size_t k = i + 1; k < j; ++k) {
+				Bits const& rest = column[k].prefixed;
+				for (auto const& entry : columns[k][i].derived)
+					for (auto const& use : byLeft[entry.first])
+						if (test(rest, use.other)) reach(use.from);
+			}
+		}
+	}
+
+	template <typename Visit>
+	void explore(size_t length, size_t& limit, Visit& visit)
+	{
+		for (Symbol t = 0; t < grammar.terminalCount(); ++t) {
+			prefix.resize(length + 1);
+			prefix[length] = t;
+			fillColumn(length + 1);
+
+			if (!test(columns[length + 1][0].prefixed, grammar.start)) continue;
+
+			if (Count derivations = derivedIn(columns[length + 1][0], grammar.start))
+				visit(prefix, derivations, limit);
+			if (length + 1 < limit) explore(length + 1, limit, visit);
+		}
+	}
+
+	bool original(Symbol A) const { return A < grammar.originalNonterminals; }
+
+	// A span split up among the symbols of a rule, with the original
+	// nonterminal of every part that has one, and their derivations.
+	struct Parts
+	{
+		std::vector<size_t> cuts;
+		std::vector<std::optional<Symbol>> symbols;
+		Count derivations;
+	};
+
+	/*
+	 * Appends to `found` a CNF rule deriving [begin, end) in `derivations`
+	 * ways, split by source rule: a rule applied directly splits the span
+	 * up as one of `direct` does, one above unit rules takes it whole.
+	 */
+	void extend(std::vector<std::pair<std::uint32_t, Parts>>& found,
+	            std::vector<CNFGrammar::Origin> const& origins, size_t begin,
+	            size_t end, Count derivations, std::vector<Parts> const& direct) const
+	{
+		for (auto const& origin : origins) {
+			if (origin.viaUnits) {
+				auto const& to = grammar.sourceRules[origin.rule].to;
+				std::optional<Symbol> unit;
+				if (to.size() == 1 && !to[0].terminal) unit = to[0].id;
+				found.push_back(
+				    {origin.rule,
+				     {{begin, end}, {unit},
+				      saturatingMul(derivations, origin.multiplicity)}});
+				continue;
+			}
+			for (auto const& parts : direct)
+				found.push_back(
+				    {origin.rule,
+				     {parts.cuts, parts.symbols,
+				      saturatingMul(parts.derivations, origin.multiplicity)}});
+		}
+	}
+
+	/*
+	 * The ways A's derivations of [i, j) split the span up among the
+	 * symbols of a source rule, with the rule. The helpers of a long rule
+	 * are spelled out into the following symbols of the rule.
+	 */
+	std::vector<std::pair<std::uint32_t, Parts>> split(Symbol A, size_t i,
+	                                                   size_t j) const
+	{
+		std::vector<std::pair<std::uint32_t, Parts>> found;
+
+		// A part for every symbol C derives [k, j) as; an <a> proxy has no
+		// source rules of its own and stays a single part.
+		auto partsOf = [this](Symbol C, size_t k, size_t end, Count c) {
+			std::vector<Parts> parts;
+			if (original(C)) return std::vector<Parts>{{{k, end}, {C}, c}};
+			for (auto& [rule, rest] : split(C, k, end))
+				parts.push_back(std::move(rest));
+			if (parts.empty()) parts.push_back({{k, end}, {std::nullopt}, c});
+			return parts;
+		};
+
+		if (j - i == 1)
+			for (std::uint32_t r : byTerminal[prefix[i]]) {
+				auto const& rule = grammar.terminalRules[r];
+				if (rule.from == A)
+					extend(found, rule.origins, i, j, 1, {{{i, j}, {std::nullopt}, 1}});
+			}
+
+		for (size_t k = i + 1; k < j; ++k)
+			for (auto const& [B, b] : columns[k][i].derived)
+				for (auto const& use : byLeft[B]) {
+					if (use.from != A) continue;
+					Count c = derivedIn(columns[j][k], use.other);
+					if (!c) continue;
+
+					const std::optional<Symbol> left =
+					    original(B) ? std::optional<Symbol>{B} : std::nullopt;
+					std::vector<Parts> direct;
+					for (auto const& rest : partsOf(use.other, k, j, c)) {
+						Parts parts{{i}, {left}, saturatingMul(b, rest.derivations)};
+						parts.cuts.insert(parts.cuts.end(), rest.cuts.begin(),
+						                  rest.cuts.end());
+						parts.symbols.insert(parts.symbols.end(),
+						                     rest.symbols.begin(), rest.symbols.end());
+						direct.push_back(std::move(parts));
+					}
+					extend(found, grammar.binaryRules[use.rule].origins, i, j,
+					       saturatingMul(b, c), direct);
+				}
+
+		return found;
+	}
+
+	// The explanation for the word in `prefix`, whose columns are filled.
+	Explanation explainPrefix() const
+	{
+		const size_t n = prefix.size();
+		Explanation point{grammar.start, 0, n, {}};
+		if (n == 0) return point;
+
+		for (;;) {
+			auto& alternatives = point.alternatives;
+			std::vector<std::optional<Symbol>> onlySymbols;
+
+			for (auto& [rule, parts] : split(point.nonterminal, point.begin, point.end)) {
+				auto same = std::find_if(
+				    alternatives.begin(), alternatives.end(),
+				    [&](Alternative const& a) {
+					    return a.rule == rule && a.cuts == parts.cuts;
+				    });
+				if (same != alternatives.end()) {
+					same->derivations =
+					    saturatingAdd(same->derivations, parts.derivations);
+					continue;
+				}
+				alternatives.push_back({rule, parts.cuts, parts.derivations});
+				onlySymbols = parts.symbols;
+			}
+
+			if (alternatives.size() != 1) return point;
+
+			// A single way, so the derivations part ways below one of its
+			// parts, if they do so in a span of its own.
+			auto const& only = alternatives.front();
+			if (only.derivations == saturated) return point;
+			std::optional<Explanation> below;
+			for (size_t p = 0; p < onlySymbols.size(); ++p)
+				if (onlySymbols[p] &&
+				    derivedIn(columns[only.cuts[p + 1]][only.cuts[p]],
+				              *onlySymbols[p]) == only.derivations)
+					below = Explanation{*onlySymbols[p], only.cuts[p],
+					                    only.cuts[p + 1], {}};
+			if (!below) return point;
+			point = std::move(*below);
+		}
+	}
+
+	void printSpan(std::ostream& out, std::vector<Symbol> const& word,
+	               size_t begin, size_t end) const
+	{
+		out << "\"";
+		grammar.printWord(out, std::vector<Symbol>(
+		                           word.begin() + static_cast<std::ptrdiff_t>(begin),
+		                           word.begin() + static_cast<std::ptrdiff_t>(end)));
+		out << "\"";
+	}
+
+public:
+	AmbiguityDetector(CNFGrammar const& grammar)
+	    : grammar(grammar), byLeft(grammar.nonterminalCount()),
+	      byTerminal(grammar.terminalCount()),
+	      words((grammar.nonterminalCount() + 63) / 64),
+	      leftCorners(grammar.nonterminalCount(), Bits(words, 0)),
+	      sums(grammar.nonterminalCount(), 0),
+	      rightCounts(grammar.nonterminalCount(), 0)
+	{
+		for (std::uint32_t r = 0; r < grammar.binaryRules.size(); ++r) {
+			auto const& rule = grammar.binaryRules[r];
+			byLeft[rule.left].push_back({rule.from, rule.right, r});
+		}
+
+		for (std::uint32_t r = 0; r < grammar.terminalRules.size(); ++r) {
+			auto const& rule = grammar.terminalRules[r];
+			byTerminal[rule.terminal].push_back(r);
+		}
+
+		std::vector<Symbol> open;
+		for (Symbol B = 0; B < grammar.nonterminalCount(); ++B) {
+			Bits& corners = leftCorners[B];
+			corners[B / 64] |= std::uint64_t{1} << (B % 64);
+			open.assign({B});
+			while (!open.empty()) {
+				const Symbol C = open.back();
+				open.pop_back();
+				for (auto const& use : byLeft[C])
+					if (!test(corners, use.from)) {
+						corners[use.from / 64] |= std::uint64_t{1} << (use.from % 64);
+						open.push_back(use.from);
+					}
+			}
+		}
+	}
+
+	AmbiguityDetector(AmbiguityDetector const&) = delete;
+
+	/*
+	 * Calls visit(word, derivations, limit) for every word of the language no
+	 * longer than `maxLength`, in no particular order. The visitor may lower
+	 * `limit`, a size_t&, to skip the words longer than it.
+	 */
+	template <typename Visit> void countWords(size_t maxLength, Visit visit)
+	{
+		columns.resize(std::max(columns.size(), maxLength + 1));
+		prefix.clear();
+
+		size_t limit = maxLength;
+		if (grammar.acceptsEmpty()) visit(prefix, grammar.empty.multiplicity, limit);
+		if (limit > 0) explore(0, limit, visit);
+	}
+
+	Count derivations(std::vector<Symbol> const& word)
+	{
+		if (word.empty()) return grammar.empty.multiplicity;
+
+		columns.resize(std::max(columns.size(), word.size() + 1));
+		prefix.clear();
+		for (size_t j = 1; j <= word.size(); ++j) {
+			prefix.push_back(word[j - 1]);
+			fillColumn(j);
+		}
+		return derivedIn(columns[word.size()][0], grammar.start);
+	}
+
+	// Where the derivations of the word part ways; see Explanation.
+	Explanation explain(std::vector<Symbol> const& word)
+	{
+		derivations(word);
+		return explainPrefix();
+	}
+
+	/*
+	 * The ambiguous words of the least length, up to `maxLength`, and at most
+	 * `maxReported` of them. Words longer than the shortest ambiguous one
+	 * found so far are not searched.
+	 */
+	std::vector<AmbiguousWord> shortestAmbiguous(size_t maxLength,
+	                                             size_t maxReported = 10)
+	{
+		std::vector<AmbiguousWord> found;
+		countWords(maxLength, [&](std::vector<Symbol> const& word,
+		                          Count derivations, size_t& limit) {
+			if (derivations < 2) return;
+			if (!found.empty() && word.size() < found.front().word.size())
+				found.clear();
+			if (found.size() == maxReported) return;
+
+			found.push_back({word, derivations, explainPrefix()});
+			limit = word.size();
+		});
+		return found;
+	}
+
+	void print(std::ostream& out, AmbiguousWord const& ambiguous) const
+	{
+		auto const& word = ambiguous.word;
+		auto const& point = ambiguous.explanation;
+
+		printSpan(out, word, 0, word.size());
+		out << " has ";
+		if (ambiguous.derivations == saturated) out << "at least ";
+		out << ambiguous.derivations << " derivations." << std::endl;
+
+		if (word.empty()) return;
+		out << "  " << grammar.nonterminals[point.nonterminal] << " derives ";
+		printSpan(out, word, point.begin, point.end);
+		out << " by:" << std::endl;
+		for (auto const& alternative : point.alternatives) {
+			out << "    ";
+			grammar.printSourceRule(out, alternative.rule);
+			auto const& cuts = alternative.cuts;
+			if (cuts.size() > 2) {
+				out << ", as";
+				for (size_t p = 0; p + 1 < cuts.size(); ++p) {
+					out << " ";
+					printSpan(out, word, cuts[p], cuts[p + 1]);
+				}
+			}
+			out << " (" << alternative.derivations << ")" << std::endl;
+		}
+	}
+};
+
+} // namespace context_free
@@ -5,6 +5,8 @@
 #include "AlphaString.h"
 #include "AlphabetTouple.h"
 #include "BottomedStack.h"
+#include "CompiledAutomaton.h"
+#include "DeterministicAutomata.h"
 #include "MeatBall.h"
 #include "ReadAlgorithm.h"
 #include "StackCommands.h"
@@ -20,11 +22,66 @@ template <typename CStack, typename CTerminal, typename CStackPtrBox> struct Aut
 
 	const MeatBall<CStack, CTerminal, CStackPtrBox>& start = meatBalls.front();
 
+	// What the stack holds before anything is read, if anything.
+	const std::optional<CStack> bottom = std::nullopt;
+
+	using Compiled = CompiledAutomaton<CStack, CTerminal, CStackPtrBox>;
+
+	// Filled in by compiled(); public only so that Automata stays an
+	// aggregate.
+	mutable std::shared_ptr<const Compiled> compiledForm{};
+
+	/*
+	 * The tables readers run on, built on first use. Threads racing for the
+	 * first use may each build them; one of the results is kept.
+	 */
+	std::shared_ptr<const Compiled> compiled() const
+	{
+		auto existing = std::atomic_load(&compiledForm);
+		if (existing) return existing;
+
+		std::shared_ptr<const Compiled> built = std::make_shared<Compiled>(
+		    meatBalls, start, stackAlphabet, wordAlphabet);
+		std::atomic_compare_exchange_strong(&compiledForm, &existing, built);
+		return existing ? existing : built;
+	}
+
+	/*
+	 * A reader for the word. The stack starts out with `bottom`, or with the
+	 * automaton's own bottom if none is given.
+	 */
+	template <typename Strategy = BreadthFirst>
 	auto createReader(AlphaString<CTerminal> const& word,
-	                  std::optional<CStack> bottom = std::nullopt)
+	                  std::optional<CStack> bottom = std::nullopt,
+	                  Strategy strategy = {}, size_t memoryLimit = SIZE_MAX) const
+	{
+		auto automaton = compiled();
+		auto stack = automaton->initialStack(bottom ? bottom : this->bottom);
+		return ReadState<CStack, CTerminal, CStackPtrBox, Strategy>{
+		    std::move(automaton), word, std::move(stack), strategy, memoryLimit};
+	}
+
+	std::vector<DeterminismConflict> conflicts() const
+	{
+		return findConflicts(meatBalls);
+	}
+
+	// Whether a reader never has more than one transition to choose from.
+	bool deterministic() const { return conflicts().empty(); }
+
+	// Whether every transition reads a char.
+	bool realTime() const { return !hasEpsilonMoves(meatBalls); }
+
+	/*
+	 * A runner for deterministic automata, which reads a word with one
+	 * stack and no forking. Throws std::logic_error for any other automaton;
+	 * see DeterministicRunner.
+	 */
+	auto createDeterministicRunner(std::optional<CStack> bottom = std::nullopt) const
 	{
-		BottomedStack<CStack, CStackPtrBox> stack{stackAlphabet, bottom};
-		return ReadState<CStack, CTerminal, CStackPtrBox>{word, start, stack};
+		return DeterministicRunner<CStack, CTerminal, CStackPtrBox>{
+		    meatBalls, start, stackAlphabet, wordAlphabet,
+		    bottom ? bottom : this->bottom};
 	}
 };
 
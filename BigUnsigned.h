@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace context_free {
+
+class BigUnsigned
+{
+	/*
+	 * An arbitrary-precision unsigned integer. Only the operations needed for
+	 * counting words and derivations are provided.
+	 *
+	 * Invariant: no trailing (most significant) zero limbs, so zero is the
+	 * empty limb vector.
+	 */
+	using Limb = std::uint32_t;
+	using Wide = std::uint64_t;
+
+	std::vector<Limb> limbs{};
+
+	void trim()
+	{
+		while (!limbs.empty() && limbs.back() == 0)
+			limbs.pop_back();
+	}
+
+public:
+	BigUnsigned() = default;
+
+	BigUnsigned(std::uint64_t value)
+	{
+		while (value) {
+			limbs.push_back(static_cast<Limb>(value));
+			value >>= 32;
+		}
+	}
+
+	bool isZero() const { return limbs.empty(); }
+
+	size_t bits() const
+	{
+		if (limbs.empty()) return 0;
+
+		size_t result = (limbs.size() - 1) * 32;
+		for (Limb top = limbs.back(); top; top >>= 1)
+			++result;
+		return result;
+	}
+
+	bool bit(size_t i) const
+	{
+		return i / 32 < limbs.size() && (limbs[i / 32] >> (i % 32)) & 1;
+	}
+
+	/*
+	 * The value truncated to its 64 least significant bits.
+	 */
+	std::uint64_t low64() const
+	{
+		std::uint64_t result = 0;
+		for (size_t i = std::min<size_t>(limbs.size(), 2); i-- > 0;)
+			result = (result << 32) | limbs[i];
+		return result;
+	}
+
+	bool fitsIn64() const { return limbs.size() <= 2; }
+
+	BigUnsigned& operator+=(BigUnsigned const& other)
+	{
+		if (limbs.size() < other.limbs.size())
+			limbs.resize(other.limbs.size(), 0);
+
+		Wide carry = 0;
+		for (size_t i = 0; i < limbs.size(); ++i) {
+			Wide sum = carry + limbs[i] +
+			           (i < other.limbs.size() ? other.limbs[i] : 0);
+			limbs[i] = static_cast<Limb>(sum);
+			carry = sum >> 32;
+		}
+		if (carry) limbs.push_back(static_cast<Limb>(carry));
+
+		return *this;
+	}
+
+	/*
+	 * Requires *this >= other.
+	 */
+	BigUnsigned& operator-=(BigUnsigned const& other)
+	{
+		if (*this < other)
+			throw std::underflow_error("BigUnsigned subtraction underflow.");
+
+		std::int64_t borrow = 0;
+		for (size_t i = 0; i < limbs.size(); ++i) {
+			std::int64_t diff = static_cast<std::int64_t>(limbs[i]) - borrow -
+			                    (i < other.limbs.size() ? other.limbs[i] : 0);
+			borrow = diff < 0;
+			limbs[i] = static_cast<Limb>(diff + (borrow << 32));
+		}
+		trim();
+
+		return *this;
+	}
+
+	friend BigUnsigned operator+(BigUnsigned a, BigUnsigned const& b)
+	{
+		return a += b;
+	}
+
+	friend BigUnsigned operator-(BigUnsigned a, BigUnsigned const& b)
+	{
+		return a -= b;
+	}
+
+	friend BigUnsigned operator*(BigUnsigned const& a, BigUnsigned const& b)
+	{
+		BigUnsigned result;
+		if (a.isZero() || b.isZero()) return result;
+
+		result.limbs.assign(a.limbs.size() + b.limbs.size(), 0);
+		for (size_t i = 0; i < a.limbs.size(); ++i) {
+			Wide carry = 0;
+			for (size_t j = 0; j < b.limbs.size(); ++j) {
+				Wide cur = result.limbs[i + j] +
+				           static_cast<Wide>(a.limbs[i]) * b.limbs[j] + carry;
+				result.limbs[i + j] = static_cast<Limb>(cur);
+				carry = cur >> 32;
+			}
+			for (size_t k = i + b.limbs.size(); carry; ++k) {
+				Wide cur = result.limbs[k] + carry;
+				result.limbs[k] = static_cast<Limb>(cur);
+				carry = cur >> 32;
+			}
+		}
+		result.trim();
+
+		return result;
+	}
+
+	BigUnsigned& operator*=(BigUnsigned const& other)
+	{
+		return *this = *this * other;
+	}
+
+	BigUnsigned& operator<<=(size_t shift)
+	{
+		if (isZero()) return *this;
+
+		size_t limbShift = shift / 32, bitShift = shift % 32;
+		limbs.insert(limbs.begin(), limbShift, 0);
+
+		if (bitShift) {
+			Limb carry = 0;
+			for (size_t i = limbShift; i < limbs.size(); ++i) {
+				Limb next = limbs[i] >> (32 - bitShift);
+				limbs[i] = (limbs[i] << bitShift) | carry;
+				carry = next;
+			}
+			if (carry) limbs.push_back(carry);
+		}
+
+		return *this;
+	}
+
+	BigUnsigned& operator>>=(size_t shift)
+	{
+		size_t limbShift = shift / 32, bitShift = shift % 32;
+		if (limbShift >= limbs.size()) {
+			limbs.clear();
+			return *this;
+		}
+		limbs.erase(limbs.begin(), limbs.begin() + limbShift);
+
+		if (bitShift) {
+			for (size_t i = 0; i < limbs.size(); ++i) {
+				limbs[i] >>= bitShift;
+				if (i + 1 < limbs.size())
+					limbs[i] |= limbs[i + 1] << (32 - bitShift);
+			}
+		}
+		trim();
+
+		return *this;
+	}
+
+	/*
+	 * Long division, one bit at a time. Good enough for unranking, which
+	 * divides only once per derivation step.
+	 */
+	static void divmod(BigUnsigned const& dividend, BigUnsigned const& divisor,
+	                   BigUnsigned& quotient, BigUnsigned& remainder)
+	{
+		if (divisor.isZero()) throw std::domain_error("Division by zero.");
+
+		quotient = {};
+		remainder = {};
+
+		for (size_t i = dividend.bits(); i-- > 0;) {
+			remainder <<= 1;
+			if (dividend.bit(i)) {
+				if (remainder.isZero())
+					remainder.limbs.push_back(1);
+				else
+					remainder.limbs[0] |= 1;
+			}
+
+			if (!(remainder < divisor)) {
+				remainder -= divisor;
+				if (quotient.limbs.size() <= i / 32)
+					quotient.limbs.resize(i / 32 + 1, 0);
+				quotient.limbs[i / 32] |= Limb{1} << (i % 32);
+			}
+		}
+	}
+
+	/*
+	 * a / b as a double, accurate even when both exceed the double range.
+	 */
+	static double ratio(BigUnsigned a, BigUnsigned b)
+	{
+		if (b.isZero()) throw std::domain_error("Division by zero.");
+
+		size_t drop = b.bits() > 64 ? b.bits() - 64 : 0;
+		a >>= drop;
+		b >>= drop;
+
+		return a.toDouble() / b.toDouble();
+	}
+
+	double toDouble() const
+	{
+		double result = 0;
+		for (size_t i = limbs.size(); i-- > 0;)
+			result = result * 4294967296.0 + limbs[i];
+		return result;
+	}
+
+	std::string toString() const
+	{
+		if (isZero()) return "0";
+
+		std::vector<Limb> digits = limbs;
+		std::string result;
+
+		while (!digits.empty()) {
+			Wide remainder = 0;
+			for (size_t i = digits.size(); i-- > 0;) {
+				Wide cur = (remainder << 32) | digits[i];
+				digits[i] = static_cast<Limb>(cur / 1000000000);
+				remainder = cur % 1000000000;
+			}
+			while (!digits.empty() && digits.back() == 0)
+				digits.pop_back();
+
+			for (int i = 0; i < 9; ++i) {
+				result.push_back(static_cast<char>('0' + remainder % 10));
+				remainder /= 10;
+				if (digits.empty() && remainder == 0) break;
+			}
+		}
+
+		std::reverse(result.begin(), result.end());
+		return result;
+	}
+
+	friend bool operator==(BigUnsigned const& a, BigUnsigned const& b)
+	{
+		return a.limbs == b.limbs;
+	}
+
+	friend bool operator!=(BigUnsigned const& a, BigUnsigned const& b)
+	{
+		return !(a == b);
+	}
+
+	friend bool operator<(BigUnsigned const& a, BigUnsigned const& b)
+	{
+		if (a.limbs.size() != b.limbs.size())
+			return a.limbs.size() < b.limbs.size();
+
+		return std::lexicographical_compare(a.limbs.rbegin(), a.limbs.rend(),
+		                                    b.limbs.rbegin(), b.limbs.rend());
+	}
+};
+
+inline std::ostream& operator<<(std::ostream& out, BigUnsigned const& n)
+{
+	return out << n.toString();
+}
+
+} // namespace context_free
@@ -3,9 +3,11 @@
 #include "AlphaString.h"
 #include "Alphabet.h"
 #include "AlphabetTouple.h"
+#include "Tracing.h"
 #include <algorithm>
 
 #include <memory>
+#include <unordered_set>
 #include <vector>
 
 namespace context_free {
@@ -20,9 +22,17 @@ template <typename CT, typename CN = CT> struct Rule
 	const FromType& from;
 	const AlphaString<ToType> to;
 
-	Rule(const FromType& from, AlphaString<ToType>&& to)
-	    : from(from), to(std::move(to))
+	/*
+	 * A probability or any other non-negative weight. Unweighted grammars
+	 * simply leave it at 1.
+	 */
+	const double weight;
+
+	Rule(const FromType& from, AlphaString<ToType>&& to, double weight = 1)
+	    : from(from), to(std::move(to)), weight(weight)
 	{
+		if (!(weight >= 0))
+			throw std::invalid_argument("Rule weights must be non-negative.");
 	}
 };
 
@@ -67,6 +77,8 @@ struct CFGrammarTouple : GrammarTouple<CT, CN>
 	                decltype(parent::rules) rules)
 	    : parent(alphabets, start, rules)
 	{
+		TraceSpan span{"CFGrammarTouple validation"};
+
 		if (!all_of(rules, [& N = *alphabets->N](auto& rule) {
 			    return N.findChar(rule.from);
 		    })) {
@@ -74,7 +86,10 @@ struct CFGrammarTouple : GrammarTouple<CT, CN>
 			    "All rules must satisfy N.findChar(rule.from) != nullptr");
 		}
 
-		if (!all_of(rules, [& alphabets = *alphabets](auto& rule) {
+		// Rules mostly share their alphabet, which is checked once.
+		std::unordered_set<const void*> checked;
+		if (!all_of(rules, [&alphabets = *alphabets, &checked](auto& rule) {
+			    if (!checked.insert(rule.to.alphabet.get()).second) return true;
 			    return rule.to.alphabet->subsetOf(alphabets);
 		    })) {
 			throw std::invalid_argument("The 'to' part of all rules must be a "
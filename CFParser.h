@@ -1,15 +1,21 @@
 #pragma once
 
 #include "CFGrammar.h"
+#include "Tracing.h"
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace context_free {
 
 using std::istream;
 
-AlphaString<LetterChar>
+inline AlphaString<LetterChar>
 parseString(istream& in, std::shared_ptr<AlphabetLike<LetterChar>> alphabet)
 {
 	std::string string;
@@ -36,14 +42,33 @@ const C& parseLetterChar(istream& input, AlphabetLike<C> const& alphabet)
 template <typename CN, typename CT = CN>
 using AlphabetsPtr = std::shared_ptr<AlphabetToupleDistinct<CN, CT>>;
 
+/*
+ * An optional rule weight follows the right-hand side as a separate token in
+ * square brackets, e.g. "S aSb [0.25]". Rules without one weigh 1.
+ */
+inline double parseWeight(istream& input)
+{
+	input >> std::ws;
+	if (input.peek() != '[') return 1;
+
+	input.get();
+	double weight;
+	if (!(input >> weight) || input.get() != ']') {
+		throw std::runtime_error("Couldn't read a rule weight of the form "
+		                         "[number] from the input");
+	}
+
+	return weight;
+}
+
 template <typename CN, typename CT>
 Rule<CN, CT> parseRule(istream& input, AlphabetsPtr<CN, CT> alphabets)
 {
 	return {parseLetterChar(input, *alphabets->N),
-	        parseString(input, alphabets)};
+	        parseString(input, alphabets), parseWeight(input)};
 }
 
-bool streamFinished(istream& input)
+inline bool streamFinished(istream& input)
 {
 	input >> std::ws;
 	return input.eof();
@@ -72,8 +97,133 @@ template <typename CN, typename CT>
 CFGrammarTouple<CN, CT> parseGrammar(istream& input,
                                      AlphabetsPtr<CN, CT> alphabets)
 {
+	TraceSpan span{"parseGrammar"};
 	return {alphabets, parseLetterChar(input, *alphabets->N),
 	        parseRules(input, alphabets)};
 }
 
+/*
+ * Interns symbol names: every distinct name gets the next 32-bit id.
+ */
+class SymbolTable
+{
+	std::unordered_map<std::string, std::uint32_t> ids{};
+	std::vector<std::string> names{};
+
+public:
+	std::uint32_t intern(std::string const& name)
+	{
+		auto found =
+		    ids.emplace(name, static_cast<std::uint32_t>(names.size()));
+		if (found.second) {
+			if (names.size() == UINT32_MAX)
+				throw std::length_error("Too many symbols for 32-bit ids.");
+			names.push_back(name);
+		}
+		return found.first->second;
+	}
+
+	std::string const& name(std::uint32_t id) const { return names[id]; }
+	size_t size() const { return names.size(); }
+};
+
+using NamedGrammar = CFGrammarTouple<TokenChar, TokenChar>;
+
+/*
+ * A grammar whose symbols are names rather than chars, for grammars too big
+ * for one char per symbol. The first line names the start symbol, every
+ * other line holds a rule: its left-hand side, the symbols of its right-hand
+ * side ("@" alone for none) and an optional weight as in parseWeight(), all
+ * separated by whitespace. Symbols on some left-hand side are nonterminals,
+ * the others terminals.
+ *
+ * Loading takes time linear in the size of the grammar.
+ */
+inline NamedGrammar parseNamedGrammar(istream& input)
+{
+	TraceSpan span{"parseNamedGrammar"};
+	SymbolTable symbols;
+	std::string line;
+
+	while (std::getline(input, line) &&
+	       line.find_first_not_of(" \t\r") == std::string::npos) {
+	}
+	std::istringstream first{line};
+	std::string startName;
+	if (!(first >> startName))
+		throw std::runtime_error("Couldn't read the start symbol from the input");
+	const std::uint32_t start = symbols.intern(startName);
+
+	// The rules, flattened: rule r has the symbols [ends[r - 1], ends[r]).
+	std::vector<std::uint32_t> from, ruleSymbols;
+	std::vector<size_t> ends;
+	std::vector<double> weights;
+	std::vector<std::uint8_t> isNonterminal;
+
+	while (std::getline(input, line)) {
+		std::istringstream rule{line};
+		std::string name;
+		if (!(rule >> name)) continue;
+		from.push_back(symbols.intern(name));
+
+		bool empty = false;
+		size_t count = 0;
+		while (rule >> std::ws && !rule.eof() && rule.peek() != '[') {
+			rule >> name;
+			if (name == "@") {
+				empty = true;
+				continue;
+			}
+			ruleSymbols.push_back(symbols.intern(name));
+			++count;
+		}
+		if (empty && count)
+			throw std::runtime_error("A rule has both @ and other symbols: " +
+			                         line);
+		if (!empty && !count)
+			throw std::runtime_error("A rule without a right-hand side: " + line);
+
+		ends.push_back(ruleSymbols.size());
+		weights.push_back(parseWeight(rule));
+	}
+
+	isNonterminal.assign(symbols.size(), 0);
+	isNonterminal[start] = 1;
+	for (std::uint32_t symbol : from)
+		isNonterminal[symbol] = 1;
+
+	std::vector<std::string> nonterminalNames, terminalNames;
+	for (std::uint32_t id = 0; id < symbols.size(); ++id)
+		(isNonterminal[id] ? nonterminalNames : terminalNames)
+		    .push_back(symbols.name(id));
+
+	auto N = std::make_shared<Alphabet<TokenChar>>(namesToPtrVec(nonterminalNames));
+	auto T = terminalNames.empty()
+	             ? Alphabet<TokenChar>::constructEmpty()
+	             : std::make_shared<Alphabet<TokenChar>>(namesToPtrVec(terminalNames));
+	auto alphabets = std::make_shared<AlphabetToupleDistinct<TokenChar, TokenChar>>(N, T);
+
+	// Both alphabets keep the order of the names, so a symbol's char is
+	// found by counting.
+	std::vector<const TokenChar*> chars(symbols.size());
+	{
+		auto nonterminal = N->begin(), terminal = T->begin();
+		for (std::uint32_t id = 0; id < symbols.size(); ++id)
+			chars[id] = isNonterminal[id] ? *nonterminal++ : *terminal++;
+	}
+
+	std::vector<Rule<TokenChar, TokenChar>> rules;
+	rules.reserve(from.size());
+	for (size_t r = 0; r < from.size(); ++r) {
+		std::vector<const TokenChar*> to;
+		for (size_t i = r ? ends[r - 1] : 0; i < ends[r]; ++i)
+			to.push_back(chars[ruleSymbols[i]]);
+		rules.emplace_back(*chars[from[r]],
+		                   AlphaString<TokenChar>::fromChars(alphabets, std::move(to)),
+		                   weights[r]);
+	}
+
+	return {alphabets, *chars[start], std::move(rules)};
+}
+
 } // namespace context_free
@@ -0,0 +1,629 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "CFGrammar.h"
+
+namespace context_free {
+
+using Symbol = std::uint32_t;
+
+/*
+ * Derivation multiplicities saturate instead of wrapping around, so that an
+ * infinitely ambiguous grammar shows up as "at least 2^64 - 1 derivations"
+ * rather than as some arbitrary small number.
+ */
+constexpr std::uint64_t saturated = std::numeric_limits<std::uint64_t>::max();
+
+inline std::uint64_t saturatingAdd(std::uint64_t a, std::uint64_t b)
+{
+	return a > saturated - b ? saturated : a + b;
+}
+
+inline std::uint64_t saturatingMul(std::uint64_t a, std::uint64_t b)
+{
+	if (a == 0 || b == 0) return 0;
+	return a > saturated / b ? saturated : a * b;
+}
+
+struct Weights
+{
+	/*
+	 * What a rule (or a chain of rules folded into one) contributes to a
+	 * derivation: how many derivation fragments of the source grammar it
+	 * stands for, their total weight and the weight of the heaviest one.
+	 * Sequencing multiplies, alternatives add (or take the maximum).
+	 */
+	std::uint64_t multiplicity = 1;
+	double weight = 1;
+	double bestWeight = 1;
+
+	static Weights none() { return {0, 0, 0}; }
+
+	static Weights of(double weight) { return {1, weight, weight}; }
+
+	friend Weights operator*(Weights const& a, Weights const& b)
+	{
+		return {saturatingMul(a.multiplicity, b.multiplicity),
+		        a.weight * b.weight, a.bestWeight * b.bestWeight};
+	}
+
+	friend Weights operator+(Weights const& a, Weights const& b)
+	{
+		return {saturatingAdd(a.multiplicity, b.multiplicity),
+		        a.weight + b.weight, std::max(a.bestWeight, b.bestWeight)};
+	}
+
+	Weights& operator+=(Weights const& other) { return *this = *this + other; }
+
+	/*
+	 * Whether `other` differs from *this by more than rounding noise.
+	 */
+	bool differsFrom(Weights const& other) const
+	{
+		auto far = [](double a, double b) {
+			return std::abs(a - b) > 1e-12 * std::max(std::abs(a), std::abs(b));
+		};
+		return multiplicity != other.multiplicity ||
+		       far(weight, other.weight) || far(bestWeight, other.bestWeight);
+	}
+};
+
+struct IndexedSymbol
+{
+	bool terminal;
+	Symbol id;
+
+	friend bool operator<(IndexedSymbol a, IndexedSymbol b)
+	{
+		return std::make_pair(a.terminal, a.id) < std::make_pair(b.terminal, b.id);
+	}
+};
+
+struct IndexedRule
+{
+	Symbol from;
+	std::vector<IndexedSymbol> to;
+	Weights weights{};
+};
+
+/*
+ * A grammar with its symbols replaced by dense integer ids. Terminals keep a
+ * pointer to the alphabet char they stand for, so words can be translated
+ * back and forth. Nonterminals only need a name.
+ */
+struct IndexedGrammar
+{
+	std::vector<const Char*> terminals{};
+	std::vector<std::string> nonterminals{};
+	Symbol start = 0;
+	std::vector<IndexedRule> rules{};
+
+	// The rules of nonterminal A are rules[ruleOffsets[A], ruleOffsets[A + 1])
+	// once indexRules() sorted them by left-hand side.
+	std::vector<std::uint32_t> ruleOffsets{};
+
+	struct RuleRange
+	{
+		const IndexedRule *first, *last;
+
+		const IndexedRule* begin() const { return first; }
+		const IndexedRule* end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+	};
+
+	/*
+	 * Groups the rules by left-hand side, keeping their order within each
+	 * group, and builds ruleOffsets. Needs to be called again after the
+	 * rules change. Linear in the number of rules.
+	 */
+	void indexRules()
+	{
+		if (rules.size() > UINT32_MAX)
+			throw std::length_error("Too many rules for 32-bit offsets.");
+
+		ruleOffsets.assign(nonterminals.size() + 1, 0);
+		for (auto const& rule : rules)
+			++ruleOffsets[rule.from + 1];
+		for (size_t A = 0; A < nonterminals.size(); ++A)
+			ruleOffsets[A + 1] += ruleOffsets[A];
+
+		std::vector<std::uint32_t> next(ruleOffsets.begin(), ruleOffsets.end() - 1),
+		    order(rules.size());
+		for (size_t r = 0; r < rules.size(); ++r)
+			order[next[rules[r].from]++] = static_cast<std::uint32_t>(r);
+
+		std::vector<IndexedRule> sorted;
+		sorted.reserve(rules.size());
+		for (std::uint32_t r : order)
+			sorted.push_back(std::move(rules[r]));
+		rules = std::move(sorted);
+	}
+
+	RuleRange rulesOf(Symbol nonterminal) const
+	{
+		return {rules.data() + ruleOffsets[nonterminal],
+		        rules.data() + ruleOffsets[nonterminal + 1]};
+	}
+};
+
+template <typename C> std::string charName(C const& c)
+{
+	std::ostringstream name;
+	c.print(name);
+	return name.str();
+}
+
+template <typename C>
+IndexedGrammar indexGrammar(CFGrammarTouple<C, C> const& grammar)
+{
+	IndexedGrammar indexed;
+	std::unordered_map<const C*, IndexedSymbol> ids;
+	indexed.rules.reserve(grammar.rules.size());
+
+	grammar.alphabets->N->for_each([&](C const& c) {
+		ids[&c] = {false, static_cast<Symbol>(indexed.nonterminals.size())};
+		indexed.nonterminals.push_back(charName(c));
+	});
+	grammar.alphabets->T->for_each([&](C const& c) {
+		ids[&c] = {true, static_cast<Symbol>(indexed.terminals.size())};
+		indexed.terminals.push_back(&c);
+	});
+
+	auto lookup = [&ids](const C* c) {
+		auto found = ids.find(c);
+		if (found == ids.end())
+			throw std::logic_error("A rule refers to a char outside of the "
+			                       "grammar's alphabets.");
+		return found->second;
+	};
+
+	indexed.start = lookup(grammar.start).id;
+
+	for (auto const& rule : grammar.rules) {
+		IndexedRule indexedRule{lookup(&rule.from).id, {},
+		                        Weights::of(rule.weight)};
+		for (const C* c : rule.to.string)
+			indexedRule.to.push_back(lookup(c));
+		indexed.rules.push_back(std::move(indexedRule));
+	}
+
+	indexed.indexRules();
+	return indexed;
+}
+
+struct CNFGrammar
+{
+	/*
+	 * A grammar in Chomsky normal form: every rule is either A -> BC or A -> a.
+	 * Whether the empty word is in the language is kept on the side.
+	 *
+	 * The multiplicity of a rule is the number of derivation fragments of the
+	 * source grammar it stands for, so derivations are counted exactly as in
+	 * the source grammar (epsilon and unit rules are folded in, not lost).
+	 * Rule weights are folded in the same way.
+	 *
+	 * Every rule also records its origins: the source rules applied first at
+	 * its left-hand side, with the part of the weights each accounts for. An
+	 * origin is reached through units if the rule is the first step under a
+	 * chain of unit and eps-shortened rules; then the source rule only
+	 * covers the whole span. Rules of the helpers made up for long rules
+	 * have the long rule as their origin, rules of the <a> proxies none.
+	 */
+	struct Origin : Weights
+	{
+		std::uint32_t rule; // in sourceRules
+		bool viaUnits;
+	};
+
+	struct BinaryRule : Weights
+	{
+		Symbol from, left, right;
+		std::vector<Origin> origins{};
+	};
+
+	struct TerminalRule : Weights
+	{
+		Symbol from, terminal;
+		std::vector<Origin> origins{};
+	};
+
+	std::vector<const Char*> terminals{};
+	std::vector<std::string> nonterminals{};
+	Symbol start = 0;
+
+	// Nonterminals [0, originalNonterminals) come from the source grammar,
+	// the rest were introduced by the conversion.
+	size_t originalNonterminals = 0;
+
+	std::vector<BinaryRule> binaryRules{};
+	std::vector<TerminalRule> terminalRules{};
+
+	// The rules of the grammar the conversion started from.
+	std::vector<IndexedRule> sourceRules{};
+
+	// The derivations start =>* eps; none() if eps is not in the language.
+	Weights empty = Weights::none();
+
+	// Set if some multiplicity hit 2^64 - 1, e.g. because of a unit cycle.
+	bool countsSaturated = false;
+
+	std::unordered_map<const Char*, Symbol> terminalIds{};
+
+	size_t nonterminalCount() const { return nonterminals.size(); }
+	size_t terminalCount() const { return terminals.size(); }
+
+	bool acceptsEmpty() const { return empty.multiplicity != 0; }
+
+	template <typename C>
+	std::vector<Symbol> encode(AlphaString<C> const& word) const
+	{
+		std::vector<Symbol> encoded;
+		encoded.reserve(word.string.size());
+
+		for (const C* c : word.string) {
+			auto found = terminalIds.find(c);
+			if (found == terminalIds.end())
+				throw std::invalid_argument(
+				    "The word contains a char that is not a terminal.");
+			encoded.push_back(found->second);
+		}
+
+		return encoded;
+	}
+
+	void printWord(std::ostream& out, std::vector<Symbol> const& word) const
+	{
+		if (word.empty()) {
+			out << "@";
+			return;
+		}
+
+		for (Symbol t : word)
+			terminals[t]->print(out);
+	}
+
+	// A rule of sourceRules, e.g. "S -> S a S".
+	void printSourceRule(std::ostream& out, std::uint32_t rule) const
+	{
+		auto const& source = sourceRules[rule];
+		out << nonterminals[source.from] << " ->";
+		if (source.to.empty()) out << " @";
+		for (auto const& symbol : source.to) {
+			out << " ";
+			if (symbol.terminal)
+				terminals[symbol.id]->print(out);
+			else
+				out << nonterminals[symbol.id];
+		}
+	}
+
+	static void printWeights(std::ostream& out, Weights const& weights)
+	{
+		out << " (x" << weights.multiplicity << ", " << weights.weight << ")";
+	}
+
+	void print(std::ostream& out) const
+	{
+		if (acceptsEmpty()) {
+			out << nonterminals[start] << " -> @";
+			printWeights(out, empty);
+			out << std::endl;
+		}
+
+		for (auto const& rule : binaryRules) {
+			out << nonterminals[rule.from] << " -> " << nonterminals[rule.left]
+			    << " " << nonterminals[rule.right];
+			printWeights(out, rule);
+			out << std::endl;
+		}
+
+		for (auto const& rule : terminalRules) {
+			out << nonterminals[rule.from] << " -> ";
+			terminals[rule.terminal]->print(out);
+			printWeights(out, rule);
+			out << std::endl;
+		}
+	}
+};
+
+/*
+ * The usual TERM, BIN, DEL, UNIT pipeline followed by removal of useless
+ * symbols. BIN runs before DEL so DEL only ever has to drop one of two
+ * symbols, which keeps the result linear in the size of the input grammar.
+ */
+inline CNFGrammar toCNF(IndexedGrammar grammar)
+{
+	auto& names = grammar.nonterminals;
+	const size_t originalNonterminals = names.size();
+	auto fresh = [&names](std::string name) {
+		names.push_back(std::move(name));
+		return static_cast<Symbol>(names.size() - 1);
+	};
+
+	// Every step below keeps, next to its rules, the source rule each one is
+	// part of; the rules of the <a> proxies are part of none.
+	constexpr std::uint32_t noSource = UINT32_MAX;
+	std::vector<IndexedRule> sourceRules = grammar.rules;
+
+	// TERM: terminals inside long right-hand sides get a proxy nonterminal.
+	std::vector<IndexedRule> rules;
+	std::vector<std::uint32_t> sources;
+	std::vector<std::optional<Symbol>> proxy(grammar.terminals.size());
+
+	for (size_t r = 0; r < grammar.rules.size(); ++r) {
+		auto& rule = grammar.rules[r];
+		if (rule.to.size() >= 2) {
+			for (auto& symbol : rule.to) {
+				if (!symbol.terminal) continue;
+
+				if (!proxy[symbol.id]) {
+					proxy[symbol.id] =
+					    fresh("<" + charName(*grammar.terminals[symbol.id]) + ">");
+					rules.push_back({*proxy[symbol.id], {symbol}});
+					sources.push_back(noSource);
+				}
+				symbol = {false, *proxy[symbol.id]};
+			}
+		}
+		rules.push_back(std::move(rule));
+		sources.push_back(static_cast<std::uint32_t>(r));
+	}
+
+	// BIN: A -> X1 X2 ... Xk becomes A -> X1 A_1, A_1 -> X2 A_2, ...
+	std::vector<IndexedRule> binarized;
+	std::vector<std::uint32_t> binarizedSources;
+	for (size_t r = 0; r < rules.size(); ++r) {
+		auto& rule = rules[r];
+		if (rule.to.size() <= 2) {
+			binarized.push_back(std::move(rule));
+			binarizedSources.push_back(sources[r]);
+			continue;
+		}
+
+		Symbol from = rule.from;
+		Weights weights = rule.weights;
+		for (size_t i = 0; i + 2 < rule.to.size(); ++i) {
+			Symbol rest = fresh(names[rule.from] + "_" + std::to_string(names.size()));
+			binarized.push_back({from, {rule.to[i], {false, rest}}, weights});
+			binarizedSources.push_back(sources[r]);
+			from = rest;
+			weights = {};
+		}
+		binarized.push_back(
+		    {from, {rule.to[rule.to.size() - 2], rule.to.back()}, weights});
+		binarizedSources.push_back(sources[r]);
+	}
+
+	const size_t N = names.size();
+
+	// DEL: sum up the eps-derivations of every nonterminal. Multiplicities
+	// that are still growing after N rounds come from a cycle and are
+	// infinite; weights around such a cycle converge (or hit infinity).
+	std::vector<Weights> nullable(N, Weights::none());
+	for (size_t round = 0; round < N + 1000; ++round) {
+		std::vector<Weights> next(N, Weights::none());
+		for (auto const& rule : binarized) {
+			Weights product = rule.weights;
+			for (auto const& symbol : rule.to)
+				product = symbol.terminal ? Weights::none()
+				                          : product * nullable[symbol.id];
+			next[rule.from] += product;
+		}
+
+		bool changed = false;
+		for (size_t A = 0; A < N; ++A) {
+			if (round > N && next[A].multiplicity != nullable[A].multiplicity)
+				next[A].multiplicity = saturated;
+			changed = changed || next[A].differsFrom(nullable[A]);
+		}
+
+		nullable = std::move(next);
+		if (!changed) break;
+	}
+
+	std::vector<IndexedRule> epsilonFree;
+	std::vector<std::uint32_t> epsilonFreeSources;
+	for (size_t r = 0; r < binarized.size(); ++r) {
+		auto const& rule = binarized[r];
+		if (rule.to.size() == 2) {
+			epsilonFree.push_back(rule);
+			epsilonFreeSources.push_back(binarizedSources[r]);
+			for (size_t drop = 0; drop < 2; ++drop) {
+				auto const& dropped = rule.to[drop];
+				if (dropped.terminal || !nullable[dropped.id].multiplicity)
+					continue;
+
+				epsilonFree.push_back({rule.from,
+				                       {rule.to[1 - drop]},
+				                       rule.weights * nullable[dropped.id]});
+				epsilonFreeSources.push_back(binarizedSources[r]);
+			}
+		} else if (rule.to.size() == 1) {
+			epsilonFree.push_back(rule);
+			epsilonFreeSources.push_back(binarizedSources[r]);
+		}
+	}
+
+	// UNIT: sum up the unit paths A =>* B, then give A a copy of every
+	// non-unit rule of B. Nodes on a unit cycle have infinitely many paths.
+	struct UnitEdge
+	{
+		Symbol to;
+		Weights weights;
+		std::uint32_t source;
+	};
+	std::vector<std::vector<UnitEdge>> unitEdges(N);
+	std::vector<std::vector<size_t>> nonUnit(N); // into epsilonFree
+	for (size_t r = 0; r < epsilonFree.size(); ++r) {
+		auto const& rule = epsilonFree[r];
+		if (rule.to.size() == 1 && !rule.to[0].terminal)
+			unitEdges[rule.from].push_back(
+			    {rule.to[0].id, rule.weights, epsilonFreeSources[r]});
+		else
+			nonUnit[rule.from].push_back(r);
+	}
+
+	struct Merged
+	{
+		Weights weights = Weights::none();
+		std::map<std::pair<std::uint32_t, bool>, Weights> origins{};
+	};
+	std::map<std::tuple<Symbol, IndexedSymbol, IndexedSymbol>, Merged> merged;
+	auto addMerged = [&](Symbol from, size_t r, Weights const& paths,
+	                     std::uint32_t origin, bool viaUnits) {
+		auto const& rule = epsilonFree[r];
+		IndexedSymbol second = rule.to.size() == 2 ? rule.to[1]
+		                                           : IndexedSymbol{true, 0};
+		Merged& entry = merged[{from, rule.to[0], second}];
+		const Weights weights = paths * rule.weights;
+		entry.weights += weights;
+		if (origin == noSource) return;
+		auto found = entry.origins.try_emplace({origin, viaUnits}, Weights::none());
+		found.first->second += weights;
+	};
+
+	// pathsFrom[A] lists every B with A =>* B and the paths between them.
+	std::vector<std::vector<std::pair<Symbol, Weights>>> pathsFrom(N);
+
+	std::vector<Weights> paths(N, Weights::none()), next(N, Weights::none());
+	std::vector<Symbol> reachable;
+	std::vector<bool> seen(N, false);
+	for (Symbol A = 0; A < N; ++A) {
+		reachable.assign({A});
+		seen[A] = true;
+		for (size_t i = 0; i < reachable.size(); ++i)
+			for (auto const& edge : unitEdges[reachable[i]])
+				if (!seen[edge.to]) {
+					seen[edge.to] = true;
+					reachable.push_back(edge.to);
+				}
+
+		// Same fixpoint as for DEL, restricted to what A reaches.
+		const size_t rounds = reachable.size() + 1;
+		for (size_t round = 0; round < rounds + 1000; ++round) {
+			for (Symbol v : reachable)
+				next[v] = v == A ? Weights{} : Weights::none();
+			for (Symbol v : reachable)
+				for (auto const& edge : unitEdges[v])
+					next[edge.to] += paths[v] * edge.weights;
+
+			bool changed = false;
+			for (Symbol v : reachable) {
+				if (round > rounds &&
+				    next[v].multiplicity != paths[v].multiplicity)
+					next[v].multiplicity = saturated;
+				changed = changed || next[v].differsFrom(paths[v]);
+				paths[v] = next[v];
+			}
+			if (!changed) break;
+		}
+
+		for (Symbol B : reachable) {
+			if (paths[B].multiplicity) pathsFrom[A].emplace_back(B, paths[B]);
+			paths[B] = Weights::none();
+			seen[B] = false;
+		}
+	}
+
+	// A keeps its own non-unit rules and gets those below every unit edge,
+	// which are credited to the source of the edge: the paths from A split
+	// by their first step.
+	for (Symbol A = 0; A < N; ++A) {
+		for (size_t r : nonUnit[A])
+			addMerged(A, r, Weights{}, epsilonFreeSources[r], false);
+		for (auto const& edge : unitEdges[A])
+			for (auto const& [B, pathWeights] : pathsFrom[edge.to])
+				for (size_t r : nonUnit[B])
+					addMerged(A, r, edge.weights * pathWeights, edge.source, true);
+	}
+
+	// Useless symbols: keep only generating nonterminals reachable from start.
+	std::vector<bool> generating(N, false);
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (auto const& [rule, entry] : merged) {
+			auto const& [from, first, second] = rule;
+			if (generating[from]) continue;
+
+			bool ok = first.terminal ||
+			          (generating[first.id] && generating[second.id]);
+			if (ok) generating[from] = changed = true;
+		}
+	}
+
+	std::vector<bool> useful(N, false);
+	std::vector<Symbol> work{grammar.start};
+	useful[grammar.start] = true;
+	std::vector<std::vector<Symbol>> successors(N);
+	for (auto const& [rule, entry] : merged) {
+		auto const& [from, first, second] = rule;
+		if (first.terminal || !generating[first.id] || !generating[second.id])
+			continue;
+		successors[from].push_back(first.id);
+		successors[from].push_back(second.id);
+	}
+	while (!work.empty()) {
+		Symbol A = work.back();
+		work.pop_back();
+		for (Symbol B : successors[A])
+			if (!useful[B]) {
+				useful[B] = true;
+				work.push_back(B);
+			}
+	}
+
+	CNFGrammar cnf;
+	cnf.terminals = std::move(grammar.terminals);
+	cnf.nonterminals = std::move(names);
+	cnf.start = grammar.start;
+	cnf.originalNonterminals = originalNonterminals;
+	cnf.empty = nullable[grammar.start];
+	cnf.countsSaturated = cnf.empty.multiplicity == saturated;
+	cnf.sourceRules = std::move(sourceRules);
+
+	for (auto const& [rule, entry] : merged) {
+		auto const& [from, first, second] = rule;
+		auto const& weights = entry.weights;
+		if (!useful[from] || !generating[from] || !weights.multiplicity)
+			continue;
+		if (!first.terminal && (!generating[first.id] || !generating[second.id]))
+			continue;
+
+		std::vector<CNFGrammar::Origin> origins;
+		for (auto const& [origin, part] : entry.origins)
+			origins.push_back({part, origin.first, origin.second});
+
+		if (first.terminal)
+			cnf.terminalRules.push_back({weights, from, first.id, std::move(origins)});
+		else
+			cnf.binaryRules.push_back(
+			    {weights, from, first.id, second.id, std::move(origins)});
+
+		if (weights.multiplicity == saturated) cnf.countsSaturated = true;
+	}
+
+	for (Symbol t = 0; t < cnf.terminals.size(); ++t)
+		cnf.terminalIds[cnf.terminals[t]] = t;
+
+	return cnf;
+}
+
+template <typename C> CNFGrammar toCNF(CFGrammarTouple<C, C> const& grammar)
+{
+	return toCNF(indexGrammar(grammar));
+}
+
+} // namespace context_free
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <cmath>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#include "CNFGrammar.h"
+#include "Semiring.h"
+
+namespace context_free {
+
+template <typename S> class Chart
+{
+	/*
+	 * One cell per span of the word, each cell a contiguous array with a
+	 * value for every nonterminal. Spans are laid out by length first, so
+	 * all spans of one length (an anti-diagonal of the CYK table) are
+	 * adjacent in memory.
+	 */
+public:
+	using value_type = typename S::value_type;
+
+	const std::vector<Symbol> word;
+	const size_t nonterminals;
+
+private:
+	std::vector<size_t> rowStart{};
+	std::vector<value_type> cells{};
+
+public:
+	Chart(std::vector<Symbol> word, size_t nonterminals)
+	    : word(std::move(word)), nonterminals(nonterminals)
+	{
+		const size_t n = this->word.size();
+		rowStart.assign(n + 2, 0);
+		for (size_t length = 1; length <= n; ++length)
+			rowStart[length + 1] = rowStart[length] + (n - length + 1);
+
+		cells.assign(rowStart[n + 1] * nonterminals, S::zero());
+	}
+
+	size_t size() const { return word.size(); }
+
+	value_type* span(size_t begin, size_t length)
+	{
+		return cells.data() + (rowStart[length] + begin) * nonterminals;
+	}
+
+	const value_type* span(size_t begin, size_t length) const
+	{
+		return cells.data() + (rowStart[length] + begin) * nonterminals;
+	}
+};
+
+struct ParseTree
+{
+	Symbol symbol;
+	bool terminal;
+	std::vector<ParseTree> children{};
+
+	/*
+	 * Prints the tree as S(a S(a b) b). Nonterminals introduced by the CNF
+	 * conversion are spliced out, so the shape follows the source grammar
+	 * except for folded unit and epsilon rules.
+	 */
+	void print(std::ostream& out, CNFGrammar const& grammar) const
+	{
+		if (terminal) {
+			grammar.terminals[symbol]->print(out);
+			return;
+		}
+
+		out << grammar.nonterminals[symbol] << "(";
+		bool first = true;
+		printChildren(out, grammar, first);
+		out << ")";
+	}
+
+private:
+	void printChildren(std::ostream& out, CNFGrammar const& grammar,
+	                   bool& first) const
+	{
+		for (auto const& child : children) {
+			if (!child.terminal &&
+			    child.symbol >= grammar.originalNonterminals) {
+				child.printChildren(out, grammar, first);
+				continue;
+			}
+
+			if (!first) out << " ";
+			first = false;
+			child.print(out, grammar);
+		}
+	}
+};
+
+template <typename S> class ChartParser
+{
+	/*
+	 * CYK over a CNF grammar, generic in the semiring: BooleanSemiring gives
+	 * membership, CountingSemiring the number of derivations,
+	 * ViterbiSemiring the best derivation and InsideSemiring the total
+	 * probability of the word.
+	 *
+	 * Binary rules are kept as a structure of arrays grouped by their left
+	 * child, so the inner loop is a straight run over contiguous rule data.
+	 */
+public:
+	using value_type = typename S::value_type;
+
+	const CNFGrammar& grammar;
+
+private:
+	std::vector<size_t> leftBegin{};
+	std::vector<Symbol> ruleFrom{}, ruleRight{};
+	std::vector<value_type> ruleValue{};
+	std::vector<size_t> ruleIndex{};
+
+	struct TerminalEntry
+	{
+		Symbol from;
+		value_type value;
+		size_t index;
+	};
+	std::vector<std::vector<TerminalEntry>> byTerminal{};
+
+	static bool same(value_type const& a, value_type const& b)
+	{
+		return !(a < b) && !(b < a);
+	}
+
+public:
+	ChartParser(CNFGrammar const& grammar)
+	    : grammar(grammar), leftBegin(grammar.nonterminalCount() + 1, 0),
+	      byTerminal(grammar.terminalCount())
+	{
+		for (auto const& rule : grammar.binaryRules)
+			++leftBegin[rule.left + 1];
+		for (size_t B = 0; B < grammar.nonterminalCount(); ++B)
+			leftBegin[B + 1] += leftBegin[B];
+
+		const size_t R = grammar.binaryRules.size();
+		ruleFrom.resize(R);
+		ruleRight.resize(R);
+		ruleValue.resize(R);
+		ruleIndex.resize(R);
+
+		std::vector<size_t> next(leftBegin.begin(), leftBegin.end() - 1);
+		for (size_t i = 0; i < R; ++i) {
+			auto const& rule = grammar.binaryRules[i];
+			size_t at = next[rule.left]++;
+			ruleFrom[at] = rule.from;
+			ruleRight[at] = rule.right;
+			ruleValue[at] = S::fromWeights(rule);
+			ruleIndex[at] = i;
+		}
+
+		for (size_t i = 0; i < grammar.terminalRules.size(); ++i) {
+			auto const& rule = grammar.terminalRules[i];
+			byTerminal[rule.terminal].push_back(
+			    {rule.from, S::fromWeights(rule), i});
+		}
+	}
+
+	ChartParser(ChartParser const&) = delete;
+
+	void fillTerminals(Chart<S>& chart) const
+	{
+		for (size_t i = 0; i < chart.size(); ++i) {
+			value_type* cell = chart.span(i, 1);
+			for (auto const& entry : byTerminal.at(chart.word[i]))
+				cell[entry.from] = S::plus(cell[entry.from], entry.value);
+		}
+	}
+
+	/*
+	 * Computes the cell of one span from the cells of its proper sub-spans,
+	 * which must be filled already.
+	 */
+	void fillSpan(Chart<S>& chart, size_t begin, size_t length) const
+	{
+		value_type* out = chart.span(begin, length);
+		const size_t N = grammar.nonterminalCount();
+
+		for (size_t k = 1; k < length; ++k) {
+			const value_type* left = chart.span(begin, k);
+			const value_type* right = chart.span(begin + k, length - k);
+
+			for (size_t B = 0; B < N; ++B) {
+				if (S::isZero(left[B])) continue;
+
+				const value_type leftValue = left[B];
+				for (size_t r = leftBegin[B]; r < leftBegin[B + 1]; ++r) {
+					const value_type product = S::times(
+					    S::times(ruleValue[r], leftValue), right[ruleRight[r]]);
+					out[ruleFrom[r]] = S::plus(out[ruleFrom[r]], product);
+				}
+			}
+		}
+	}
+
+	Chart<S> makeChart(std::vector<Symbol> word) const
+	{
+		return {std::move(word), grammar.nonterminalCount()};
+	}
+
+	Chart<S> parse(std::vector<Symbol> word) const
+	{
+		Chart<S> chart = makeChart(std::move(word));
+		fillTerminals(chart);
+
+		for (size_t length = 2; length <= chart.size(); ++length)
+			for (size_t begin = 0; begin + length <= chart.size(); ++begin)
+				fillSpan(chart, begin, length);
+
+		return chart;
+	}
+
+	value_type total(Chart<S> const& chart) const
+	{
+		if (chart.size() == 0) return S::fromWeights(grammar.empty);
+		return chart.span(0, chart.size())[grammar.start];
+	}
+
+	value_type total(std::vector<Symbol> word) const
+	{
+		return total(parse(std::move(word)));
+	}
+
+	/*
+	 * The outside pass: outside(i, l)[A] sums (in the semiring) over all
+	 * ways to complete A spanning [i, i + l) into a derivation of the whole
+	 * word.
+	 */
+	Chart<S> outside(Chart<S> const& inside) const
+	{
+		Chart<S> outer{inside.word, grammar.nonterminalCount()};
+		const size_t n = inside.size();
+		if (n == 0) return outer;
+
+		outer.span(0, n)[grammar.start] = S::one();
+
+		for (size_t length = n; length >= 2; --length) {
+			for (size_t begin = 0; begin + length <= n; ++begin) {
+				const value_type* out = outer.span(begin, length);
+
+				for (size_t k = 1; k < length; ++k) {
+					const value_type* left = inside.span(begin, k);
+					const value_type* right = inside.span(begin + k, length - k);
+					value_type* outLeft = outer.span(begin, k);
+					value_type* outRight = outer.span(begin + k, length - k);
+
+					for (size_t B = 0; B < grammar.nonterminalCount(); ++B) {
+						for (size_t r = leftBegin[B]; r < leftBegin[B + 1]; ++r) {
+							const value_type above = out[ruleFrom[r]];
+							if (S::isZero(above)) continue;
+
+							const value_type weighted = S::times(above, ruleValue[r]);
+							const Symbol C = ruleRight[r];
+							outLeft[B] = S::plus(outLeft[B], S::times(weighted, right[C]));
+							outRight[C] = S::plus(outRight[C], S::times(weighted, left[B]));
+						}
+					}
+				}
+			}
+		}
+
+		return outer;
+	}
+
+	struct RuleExpectations
+	{
+		std::vector<double> binary, terminal;
+	};
+
+	/*
+	 * Inside-outside: the expected number of uses of every CNF rule in a
+	 * derivation of the word, indexed like grammar.binaryRules and
+	 * grammar.terminalRules. Only meaningful for InsideSemiring.
+	 */
+	RuleExpectations expectedRuleCounts(Chart<S> const& inside) const
+	{
+		RuleExpectations expectations{
+		    std::vector<double>(grammar.binaryRules.size(), 0),
+		    std::vector<double>(grammar.terminalRules.size(), 0)};
+
+		const value_type whole = total(inside);
+		if (S::isZero(whole) || inside.size() == 0) return expectations;
+
+		Chart<S> outer = outside(inside);
+		const size_t n = inside.size();
+
+		for (size_t i = 0; i < n; ++i)
+			for (auto const& entry : byTerminal[inside.word[i]]) {
+				value_type above = outer.span(i, 1)[entry.from];
+				if (!S::isZero(above))
+					expectations.terminal[entry.index] +=
+					    std::exp(S::times(above, entry.value) - whole);
+			}
+
+		for (size_t length = 2; length <= n; ++length)
+			for (size_t begin = 0; begin + length <= n; ++begin) {
+				const value_type* out = outer.span(begin, length);
+				for (size_t k = 1; k < length; ++k) {
+					const value_type* left = inside.span(begin, k);
+					const value_type* right = inside.span(begin + k, length - k);
+
+					for (size_t B = 0; B < grammar.nonterminalCount(); ++B) {
+						if (S::isZero(left[B])) continue;
+						for (size_t r = leftBegin[B]; r < leftBegin[B + 1]; ++r) {
+							value_type product = S::times(
+							    S::times(out[ruleFrom[r]], ruleValue[r]),
+							    S::times(left[B], right[ruleRight[r]]));
+							if (!S::isZero(product))
+								expectations.binary[ruleIndex[r]] +=
+								    std::exp(product - whole);
+						}
+					}
+				}
+			}
+
+		return expectations;
+	}
+
+	/*
+	 * Reads one best derivation back off a chart. Only makes sense when plus
+	 * picks one of its arguments (Viterbi, or Boolean for "any parse").
+	 */
+	std::optional<ParseTree> bestParse(Chart<S> const& chart) const
+	{
+		static_assert(S::selective, "bestParse() needs a selective semiring.");
+
+		if (S::isZero(total(chart))) return std::nullopt;
+		if (chart.size() == 0) return ParseTree{grammar.start, false};
+
+		return buildTree(chart, grammar.start, 0, chart.size());
+	}
+
+private:
+	ParseTree buildTree(Chart<S> const& chart, Symbol A, size_t begin,
+	                    size_t length) const
+	{
+		const value_type target = chart.span(begin, length)[A];
+
+		if (length == 1) {
+			return {A, false, {{chart.word[begin], true}}};
+		}
+
+		for (size_t k = 1; k < length; ++k) {
+			const value_type* left = chart.span(begin, k);
+			const value_type* right = chart.span(begin + k, length - k);
+
+			for (size_t B = 0; B < grammar.nonterminalCount(); ++B) {
+				if (S::isZero(left[B])) continue;
+				for (size_t r = leftBegin[B]; r < leftBegin[B + 1]; ++r) {
+					if (ruleFrom[r] != A) continue;
+
+					value_type product = S::times(
+					    S::times(ruleValue[r], left[B]), right[ruleRight[r]]);
+					if (S::isZero(product) || !same(product, target)) continue;
+
+					return {A,
+					        false,
+					        {buildTree(chart, static_cast<Symbol>(B), begin, k),
+					         buildTree(chart, ruleRight[r], begin + k,
+					                   length - k)}};
+				}
+			}
+		}
+
+		throw std::logic_error("Chart is inconsistent: no derivation found.");
+	}
+};
+
+} // namespace context_free
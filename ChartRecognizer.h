@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class BitChart
+{
+	/*
+	 * A membership-only CYK chart, stored twice so that the split points of
+	 * a span can be tested 64 at a time:
+	 *
+	 *  - ends(A, i) is a bitset over j of the spans [i, j) that A derives,
+	 *  - starts(A, j) is a bitset over i of the same spans.
+	 *
+	 * A -> BC derives [i, j) iff ends(B, i) & starts(C, j) is not empty.
+	 *
+	 * Only i < j matters, so a row keeps the words of that triangle alone:
+	 * ends(A, i) starts at word i / 64 and starts(A, j) ends at word j / 64,
+	 * while bit k stays in word k / 64 in both. That is two bits per span
+	 * and nonterminal, plus a word per row: for 10k chars and 100
+	 * nonterminals, 1.25 GB, where a byte per cell would take 5 GB.
+	 */
+public:
+	using Word = std::uint64_t;
+
+	const std::vector<Symbol> word;
+	const size_t nonterminals;
+
+private:
+	const size_t lastWord;
+	// Where the rows of every begin, or of every end, start.
+	std::vector<size_t> endRows{}, startRows{};
+	std::vector<Word> endBits{}, startBits{};
+
+	size_t endsLength(size_t begin) const { return lastWord - begin / 64 + 1; }
+	size_t startsLength(size_t end) const { return end / 64 + 1; }
+
+public:
+	BitChart(std::vector<Symbol> word, size_t nonterminals)
+	    : word(std::move(word)), nonterminals(nonterminals),
+	      lastWord(this->word.size() / 64), endRows(this->word.size() + 2, 0),
+	      startRows(this->word.size() + 2, 0)
+	{
+		for (size_t i = 0; i <= size(); ++i) {
+			endRows[i + 1] = endRows[i] + endsLength(i) * nonterminals;
+			startRows[i + 1] = startRows[i] + startsLength(i) * nonterminals;
+		}
+		endBits.assign(endRows.back(), 0);
+		startBits.assign(startRows.back(), 0);
+	}
+
+	size_t size() const { return word.size(); }
+
+	// Word w of the row is ends(A, begin)[w - begin / 64].
+	const Word* ends(Symbol A, size_t begin) const
+	{
+		return endBits.data() + endRows[begin] + A * endsLength(begin);
+	}
+
+	// Word w of the row is starts(A, end)[w].
+	const Word* starts(Symbol A, size_t end) const
+	{
+		return startBits.data() + startRows[end] + A * startsLength(end);
+	}
+
+	bool test(Symbol A, size_t begin, size_t end) const
+	{
+		return (ends(A, begin)[end / 64 - begin / 64] >> (end % 64)) & 1;
+	}
+
+	void set(Symbol A, size_t begin, size_t end)
+	{
+		endBits[endRows[begin] + A * endsLength(begin) + end / 64 - begin / 64] |=
+		    Word{1} << (end % 64);
+		startBits[startRows[end] + A * startsLength(end) + begin / 64] |=
+		    Word{1} << (begin % 64);
+	}
+};
+
+class ChartRecognizer
+{
+	/*
+	 * Bit-parallel CYK membership test. ChartParser with BooleanSemiring
+	 * gives the same answers, but tries the split points of a span one at a
+	 * time and spends a byte per nonterminal and span.
+	 */
+public:
+	const CNFGrammar& grammar;
+
+private:
+	// Binary rules grouped by their left-hand side.
+	std::vector<size_t> fromBegin{};
+	std::vector<Symbol> ruleLeft{}, ruleRight{};
+	std::vector<std::vector<Symbol>> byTerminal{};
+
+public:
+	ChartRecognizer(CNFGrammar const& grammar)
+	    : grammar(grammar), fromBegin(grammar.nonterminalCount() + 1, 0),
+	      byTerminal(grammar.terminalCount())
+	{
+		for (auto const& rule : grammar.binaryRules)
+			++fromBegin[rule.from + 1];
+		for (size_t A = 0; A < grammar.nonterminalCount(); ++A)
+			fromBegin[A + 1] += fromBegin[A];
+
+		ruleLeft.resize(grammar.binaryRules.size());
+		ruleRight.resize(grammar.binaryRules.size());
+		std::vector<size_t> next(fromBegin.begin(), fromBegin.end() - 1);
+		for (auto const& rule : grammar.binaryRules) {
+			size_t at = next[rule.from]++;
+			ruleLeft[at] = rule.left;
+			ruleRight[at] = rule.right;
+		}
+
+		for (auto const& rule : grammar.terminalRules)
+			byTerminal[rule.terminal].push_back(rule.from);
+	}
+
+	ChartRecognizer(ChartRecognizer const&) = delete;
+
+	BitChart makeChart(std::vector<Symbol> word) const
+	{
+		return {std::move(word), grammar.nonterminalCount()};
+	}
+
+	void fillTerminals(BitChart& chart) const
+	{
+		for (size_t i = 0; i < chart.size(); ++i)
+			for (Symbol A : byTerminal.at(chart.word[i]))
+				chart.set(A, i, i + 1);
+	}
+
+	/*
+	 * Computes the span [begin, begin + length) from its proper sub-spans,
+	 * which must be filled already. Only the rows of this span's own start
+	 * and end are read or written, so all spans of one length can be filled
+	 * concurrently.
+	 */
+	void fillSpan(BitChart& chart, size_t begin, size_t length) const
+	{
+		using Word = BitChart::Word;
+
+		const size_t end = begin + length;
+		const size_t first = (begin + 1) / 64, last = (end - 1) / 64;
+		const size_t offset = begin / 64;
+		const Word lowMask = ~Word{0} << ((begin + 1) % 64);
+		const Word highMask = ~Word{0} >> (63 - (end - 1) % 64);
+
+		for (Symbol A = 0; A < grammar.nonterminalCount(); ++A) {
+			for (size_t r = fromBegin[A]; r < fromBegin[A + 1]; ++r) {
+				const Word* left = chart.ends(ruleLeft[r], begin);
+				const Word* right = chart.starts(ruleRight[r], end);
+
+				Word splits = 0;
+				for (size_t w = first; w <= last && !splits; ++w) {
+					splits = left[w - offset] & right[w];
+					if (w == first) splits &= lowMask;
+					if (w == last) splits &= highMask;
+				}
+
+				if (splits) {
+					chart.set(A, begin, end);
+					break;
+				}
+			}
+		}
+	}
+
+	BitChart parse(std::vector<Symbol> word) const
+	{
+		BitChart chart = makeChart(std::move(word));
+		fillTerminals(chart);
+
+		for (size_t length = 2; length <= chart.size(); ++length)
+			for (size_t begin = 0; begin + length <= chart.size(); ++begin)
+				fillSpan(chart, begin, length);
+
+		return chart;
+	}
+
+	bool accepted(BitChart const& chart) const
+	{
+		if (chart.size() == 0) return grammar.acceptsEmpty();
+		return chart.test(grammar.start, 0, chart.size());
+	}
+
+	bool recognize(std::vector<Symbol> word) const
+	{
+		return accepted(parse(std::move(word)));
+	}
+};
+
+} // namespace context_free
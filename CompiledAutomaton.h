@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <forward_list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "MeatBall.h"
+
+namespace context_free {
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+class CompiledAutomaton
+{
+	/*
+	 * An automaton translated for readers: states, stack chars and input
+	 * chars become dense ids and the transitions become tables indexed by
+	 * them, so a reader never probes MeatBall's maps.
+	 *
+	 * Epsilon transitions are resolved here as well. For every state and
+	 * stack top, closure() lists the configurations epsilon moves lead to,
+	 * each as one Action with the stack effects of the whole path composed.
+	 * Composing stops where the path would need to look at a stack char it
+	 * did not push itself, or where it comes back to a state and top it has
+	 * already been in with a different stack (a loop growing the stack).
+	 * Such outcomes are marked open: after applying one, a reader looks up
+	 * the closure of the configuration it reached.
+	 *
+	 * yield() gives for every stack char a lower bound of the input it takes
+	 * to remove it from the stack again, which lets readers drop runs whose
+	 * stack can no longer be emptied by the rest of the word. That is what
+	 * stops loops like the expansion of a left-recursive nonterminal.
+	 */
+public:
+	using Id = std::uint32_t;
+	using MeatBallT = MeatBall<CStack, CTerminal, CStackPtrBox>;
+
+	static constexpr size_t unbounded = SIZE_MAX;
+
+	struct Action
+	{
+		Id target;
+		Id pops;
+		Id pushBegin, pushEnd; // into pushed(), the last one ends on top
+	};
+
+	struct Outcome
+	{
+		Action action;
+		bool open;
+	};
+
+	template <typename T> struct Slice
+	{
+		const T *first, *last;
+
+		const T* begin() const { return first; }
+		const T* end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+	};
+
+	// Paths followed per closure() entry before the rest is left open.
+	static constexpr size_t maxOutcomes = 1024;
+
+private:
+	size_t stateCount = 0, symbolCount = 0, terminalCount = 0;
+	Id startState = 0;
+
+	const std::shared_ptr<AlphabetLike<CStack, CStackPtrBox>> stackAlphabet;
+	std::map<CStack, Id> symbolIds{};
+	std::map<CTerminal, Id> inputIds{};
+	std::vector<std::string> stateNames{};
+
+	std::vector<Id> pushes{};
+
+	// CSR tables: [(state * (G + 1) + top) * (T + 1) + input] for reads,
+	// [state * (G + 1) + top] for epsilon moves and closures.
+	std::vector<size_t> readOffsets{}, epsilonOffsets{}, closureOffsets{};
+	std::vector<Action> readActions{}, epsilonActions{};
+	std::vector<Outcome> outcomes{};
+
+	std::vector<size_t> yields{};
+
+	static constexpr size_t scanned = 16;
+	std::vector<std::pair<const CTerminal*, Id>> fewTerminals{};
+	std::unordered_map<const CTerminal*, Id> terminalIds{};
+
+	std::optional<Id> boxedSymbol(CStack const& c) const
+	{
+		auto inAlphabet = stackAlphabet->findChar(c);
+		if (!inAlphabet) return std::nullopt;
+		auto found = symbolIds.find(CStack{inAlphabet});
+		if (found == symbolIds.end()) return std::nullopt;
+		return found->second;
+	}
+
+	size_t configuration(Id state, Id top) const
+	{
+		return state * (symbolCount + 1) + top;
+	}
+
+	size_t readSlot(Id state, Id top, Id input) const
+	{
+		return configuration(state, top) * (terminalCount + 1) + input;
+	}
+
+	static size_t add(size_t a, size_t b)
+	{
+		return a > unbounded - b ? unbounded : a + b;
+	}
+
+	void composeClosure(Id state, Id top);
+	void computeYields();
+
+public:
+	CompiledAutomaton(
+	    std::forward_list<MeatBallT> const& meatBalls, MeatBallT const& start,
+	    std::shared_ptr<AlphabetLike<CStack, CStackPtrBox>> stackAlphabet,
+	    std::shared_ptr<AlphabetLike<CTerminal>> const& wordAlphabet)
+	    : stackAlphabet(std::move(stackAlphabet))
+	{
+		std::map<const MeatBallT*, Id> stateIds;
+		for (auto const& meatBall : meatBalls) {
+			stateIds.emplace(&meatBall, static_cast<Id>(stateIds.size()));
+			stateNames.push_back(meatBall.human_name);
+		}
+		stateCount = stateIds.size();
+		startState = stateIds.at(&start);
+
+		// The stack holds what the alphabet hands out for a char, which is
+		// what transitions compare the top with.
+		auto symbolOf = [this](CStack const& c) -> std::optional<Id> {
+			auto inAlphabet = this->stackAlphabet->findChar(c);
+			if (!inAlphabet) return std::nullopt;
+			return symbolIds
+			    .emplace(CStack{inAlphabet}, static_cast<Id>(symbolIds.size()))
+			    .first->second;
+		};
+
+		struct Entry
+		{
+			Id state;
+			std::optional<Id> top;
+			std::optional<Id> input;
+			Action action;
+		};
+		std::vector<Entry> entries;
+
+		for (auto const& meatBall : meatBalls)
+			for (auto const& [from, to] : meatBall.transitions) {
+				std::optional<Id> top;
+				if (from.first) {
+					top = symbolOf(*from.first);
+					if (!top) continue; // the top can never be there
+				}
+
+				std::optional<Id> input;
+				if (from.second)
+					input = inputIds
+					            .emplace(*from.second,
+					                     static_cast<Id>(inputIds.size()))
+					            .first->second;
+
+				for (auto const& [command, target] : to) {
+					auto effect = command->effect();
+					Action action{stateIds.at(target), static_cast<Id>(effect.pops),
+					              static_cast<Id>(pushes.size()), 0};
+
+					bool possible = true;
+					for (auto const& c : effect.pushes) {
+						auto symbol = symbolOf(c);
+						if (!symbol) {
+							possible = false;
+							break;
+						}
+						pushes.push_back(*symbol);
+					}
+					if (!possible) { // the push would throw: the run dies here
+						pushes.resize(action.pushBegin);
+						continue;
+					}
+					action.pushEnd = static_cast<Id>(pushes.size());
+
+					entries.push_back({stateIds.at(&meatBall), top, input, action});
+				}
+			}
+
+		symbolCount = symbolIds.size() + 1; // foreign() included
+		terminalCount = inputIds.size();
+		const Id empty = static_cast<Id>(symbolCount);
+
+		auto fill = [&](std::vector<size_t>& offsets, std::vector<Action>& actions,
+		                size_t slots, auto slotOf, bool reading) {
+			offsets.assign(slots + 1, 0);
+			for (auto const& entry : entries)
+				if (entry.input.has_value() == reading) ++offsets[slotOf(entry) + 1];
+			for (size_t i = 0; i < slots; ++i)
+				offsets[i + 1] += offsets[i];
+
+			actions.resize(offsets.back());
+			std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+			for (auto const& entry : entries)
+				if (entry.input.has_value() == reading)
+					actions[next[slotOf(entry)]++] = entry.action;
+		};
+
+		fill(readOffsets, readActions,
+		     stateCount * (symbolCount + 1) * (terminalCount + 1),
+		     [&](Entry const& entry) {
+			     return readSlot(entry.state, entry.top.value_or(empty), *entry.input);
+		     },
+		     true);
+		fill(epsilonOffsets, epsilonActions, stateCount * (symbolCount + 1),
+		     [&](Entry const& entry) {
+			     return configuration(entry.state, entry.top.value_or(empty));
+		     },
+		     false);
+
+		closureOffsets.assign(1, 0);
+		for (Id state = 0; state < stateCount; ++state)
+			for (Id top = 0; top <= empty; ++top) {
+				composeClosure(state, top);
+				closureOffsets.push_back(outcomes.size());
+			}
+
+		computeYields();
+
+		// Chars that no transition reads share the last column, which stays
+		// empty.
+		wordAlphabet->for_each([&](CTerminal const& c) {
+			auto found = inputIds.find(c);
+			fewTerminals.emplace_back(&c, found == inputIds.end()
+			                                  ? static_cast<Id>(terminalCount)
+			                                  : found->second);
+		});
+		if (fewTerminals.size() > scanned)
+			terminalIds.insert(fewTerminals.begin(), fewTerminals.end());
+	}
+
+	CompiledAutomaton(CompiledAutomaton const&) = delete;
+
+	size_t states() const { return stateCount; }
+	size_t symbols() const { return symbolCount; }
+	size_t terminals() const { return terminalCount; }
+
+	Id start() const { return startState; }
+
+	// The top id of an empty stack.
+	Id empty() const { return static_cast<Id>(symbolCount); }
+
+	std::string const& name(Id state) const { return stateNames.at(state); }
+
+	// The input id of a char, terminals() for chars no transition reads.
+	std::optional<Id> input(const CTerminal* c) const
+	{
+		if (terminalIds.empty()) {
+			for (auto const& [known, id] : fewTerminals)
+				if (known == c) return id;
+			return std::nullopt;
+		}
+
+		auto found = terminalIds.find(c);
+		if (found == terminalIds.end()) return std::nullopt;
+		return found->second;
+	}
+
+	/*
+	 * The stack a reader starts with. Throws std::invalid_argument for a
+	 * bottom outside of the stack alphabet.
+	 */
+	std::vector<Id> initialStack(std::optional<CStack> const& bottom) const
+	{
+		if (!bottom) return {};
+
+		if (!stackAlphabet->findChar(*bottom))
+			throw std::invalid_argument(
+			    "The stack bottom is not in the stack alphabet.");
+
+		auto symbol = boxedSymbol(*bottom);
+		return {symbol ? *symbol : foreign()};
+	}
+
+	// Stands for the stack chars no transition tests for or pushes.
+	Id foreign() const { return static_cast<Id>(symbolIds.size()); }
+
+	Id const* pushed() const { return pushes.data(); }
+
+	Slice<Action> reads(Id state, Id top, Id input) const
+	{
+		const size_t slot = readSlot(state, top, input);
+		return {readActions.data() + readOffsets[slot],
+		        readActions.data() + readOffsets[slot + 1]};
+	}
+
+	Slice<Action> epsilonMoves(Id state, Id top) const
+	{
+		const size_t slot = configuration(state, top);
+		return {epsilonActions.data() + epsilonOffsets[slot],
+		        epsilonActions.data() + epsilonOffsets[slot + 1]};
+	}
+
+	Slice<Outcome> closure(Id state, Id top) const
+	{
+		const size_t slot = configuration(state, top);
+		return {outcomes.data() + closureOffsets[slot],
+		        outcomes.data() + closureOffsets[slot + 1]};
+	}
+
+	size_t yield(Id symbol) const
+	{
+		return symbol < symbolCount ? yields[symbol] : 0;
+	}
+
+	/*
+	 * Applies an action to a stack. Returns false, leaving the stack
+	 * alone, if the stack is too short for it.
+	 */
+	bool apply(Action const& action, std::vector<Id>& stack) const
+	{
+		if (action.pops > stack.size()) return false;
+		stack.resize(stack.size() - action.pops);
+		stack.insert(stack.end(), pushes.begin() + action.pushBegin,
+		             pushes.begin() + action.pushEnd);
+		return true;
+	}
+};
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+void CompiledAutomaton<CStack, CTerminal, CStackPtrBox>::composeClosure(Id state,
+                                                                         Id top)
+{
+	/*
+	 * A path is followed symbolically from a stack with `top` on top: it
+	 * pops `pops` chars of the real stack and leaves `above` on it.
+	 */
+	struct Path
+	{
+		Id state, pops;
+		std::vector<Id> above;
+
+		bool operator<(Path const& other) const
+		{
+			return std::tie(state, pops, above) <
+			       std::tie(other.state, other.pops, other.above);
+		}
+	};
+
+	std::set<std::pair<Path, bool>> recorded;
+	size_t budget = maxOutcomes;
+
+	auto record = [&](Path const& path, bool open) {
+		if (!recorded.insert({path, open}).second) return;
+
+		Action action{path.state, path.pops, static_cast<Id>(pushes.size()), 0};
+		pushes.insert(pushes.end(), path.above.begin(), path.above.end());
+		action.pushEnd = static_cast<Id>(pushes.size());
+		outcomes.push_back({action, open});
+	};
+
+	// Depth-first, with the (state, top) pairs and paths on the way down.
+	std::vector<std::pair<Path, size_t>> stack; // path, next epsilon move
+	std::vector<std::pair<Id, Id>> seen;
+
+	auto topOf = [top](Path const& path) -> std::optional<Id> {
+		if (!path.above.empty()) return path.above.back();
+		if (path.pops == 0) return top;
+		return std::nullopt;
+	};
+
+	record({state, 0, {}}, false);
+	stack.push_back({{state, 0, {}}, 0});
+	seen.emplace_back(state, top);
+
+	while (!stack.empty()) {
+		auto& [path, next] = stack.back();
+		auto moves = epsilonMoves(path.state, *topOf(path));
+
+		if (next == moves.size()) {
+			stack.pop_back();
+			seen.pop_back();
+			continue;
+		}
+
+		Action const& move = moves.begin()[next++];
+		Path reached{move.target, path.pops, path.above};
+		const size_t kept = std::min<size_t>(move.pops, reached.above.size());
+		reached.above.resize(reached.above.size() - kept);
+		reached.pops += static_cast<Id>(move.pops - kept);
+		reached.above.insert(reached.above.end(), pushes.begin() + move.pushBegin,
+		                     pushes.begin() + move.pushEnd);
+
+		auto reachedTop = topOf(reached);
+		if (!reachedTop) { // the real stack decides how to go on
+			record(reached, true);
+			continue;
+		}
+
+		bool repeated = false, same = false;
+		for (size_t i = 0; i < seen.size(); ++i)
+			if (seen[i] == std::make_pair(reached.state, *reachedTop)) {
+				repeated = true;
+				same = same || (!(stack[i].first < reached) &&
+				                !(reached < stack[i].first));
+			}
+		if (same) continue; // a loop that changes nothing
+
+		if (repeated || !budget) {
+			record(reached, true);
+			continue;
+		}
+
+		--budget;
+		record(reached, false);
+		stack.push_back({std::move(reached), 0});
+		seen.emplace_back(stack.back().first.state, *reachedTop);
+	}
+}
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+void CompiledAutomaton<CStack, CTerminal, CStackPtrBox>::computeYields()
+{
+	/*
+	 * A potential: every move may lower the sum of the yields on the stack
+	 * by at most the number of chars it reads. Moves that pop one char X
+	 * bound yield(X); moves popping more than one are not worth the trouble
+	 * and turn the bound off.
+	 */
+	yields.assign(symbolCount, unbounded);
+	const Id empty = static_cast<Id>(symbolCount);
+
+	for (auto const& action : epsilonActions)
+		if (action.pops > 1) {
+			yields.assign(symbolCount, 0);
+			return;
+		}
+	for (auto const& action : readActions)
+		if (action.pops > 1) {
+			yields.assign(symbolCount, 0);
+			return;
+		}
+
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (Id state = 0; state < stateCount; ++state)
+			for (Id top = 0; top < empty; ++top) {
+				auto lower = [&](Action const& action, size_t read) {
+					if (action.pops != 1) return;
+					size_t cost = read;
+					for (Id i = action.pushBegin; i < action.pushEnd; ++i)
+						cost = add(cost, yields[pushes[i]]);
+					if (cost < yields[top]) {
+						yields[top] = cost;
+						changed = true;
+					}
+				};
+
+				for (auto const& action : epsilonMoves(state, top))
+					lower(action, 0);
+				for (Id input = 0; input < terminalCount; ++input)
+					for (auto const& action : reads(state, top, input))
+						lower(action, 1);
+			}
+	}
+}
+
+} // namespace context_free
@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AlphaString.h"
+#include "MeatBall.h"
+
+namespace context_free {
+
+/*
+ * A place where a reader would have to fork: in `state`, with `stackTop` on
+ * the stack (or "-" for an empty stack), reading `input`, `choices`
+ * transitions apply.
+ */
+struct DeterminismConflict
+{
+	std::string state, stackTop, input;
+	size_t choices;
+};
+
+inline std::ostream& operator<<(std::ostream& out,
+                                DeterminismConflict const& conflict)
+{
+	return out << conflict.state << ": " << conflict.stackTop << ", "
+	           << conflict.input << " has " << conflict.choices
+	           << " transitions";
+}
+
+/*
+ * Every (MeatBall, stack top, input char) for which more than one transition
+ * applies. An epsilon transition applies whatever the input, so it conflicts
+ * with every other transition for the same stack top; such conflicts are
+ * reported with "{eps}" as the input.
+ */
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+std::vector<DeterminismConflict> findConflicts(
+    std::forward_list<MeatBall<CStack, CTerminal, CStackPtrBox>> const& meatBalls)
+{
+	using MeatBallT = MeatBall<CStack, CTerminal, CStackPtrBox>;
+
+	std::vector<DeterminismConflict> conflicts;
+	for (auto const& meatBall : meatBalls) {
+		std::map<std::optional<CStack>, size_t> epsilon, any;
+		for (auto const& [from, to] : meatBall.transitions) {
+			any[from.first] += to.size();
+			if (!from.second.has_value()) epsilon[from.first] += to.size();
+
+			if (!from.second.has_value() || to.size() < 2) continue;
+
+			std::ostringstream top, input;
+			MeatBallT::printOr(top, from.first, "-");
+			from.second->print(input);
+			conflicts.push_back(
+			    {meatBall.human_name, top.str(), input.str(), to.size()});
+		}
+
+		for (auto const& [stackTop, count] : epsilon) {
+			if (any[stackTop] < 2) continue;
+
+			std::ostringstream top;
+			MeatBallT::printOr(top, stackTop, "-");
+			conflicts.push_back(
+			    {meatBall.human_name, top.str(), "{eps}", any[stackTop]});
+		}
+	}
+	return conflicts;
+}
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+bool hasEpsilonMoves(
+    std::forward_list<MeatBall<CStack, CTerminal, CStackPtrBox>> const& meatBalls)
+{
+	for (auto const& meatBall : meatBalls)
+		for (auto const& [from, to] : meatBall.transitions)
+			if (!from.second.has_value() && !to.empty()) return true;
+	return false;
+}
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+class DeterministicRunner
+{
+	/*
+	 * Runs an automaton without any forking: one stack of dense symbol ids,
+	 * changed in place, and a table with the single transition for every
+	 * (state, stack top, input char). A step is a table lookup and a few
+	 * stores, so a word is read in a few cycles per char.
+	 *
+	 * In a deterministic automaton an epsilon move is the only move for its
+	 * state and stack top (see findConflicts()), so there is just one way
+	 * to follow it. The moves from every state and top up to the next char
+	 * read are composed into one action when the runner is built. A path
+	 * that pops the top it started from ends there, and the runner goes on
+	 * with the path of the top below. A path that comes back to a state and
+	 * top while that top is still on the stack loops forever, and the run
+	 * never reads another char.
+	 *
+	 * Like ReadState, a word is accepted when the stack is empty after its
+	 * last char, epsilon moves included.
+	 */
+	using Id = std::uint32_t;
+	using MeatBallT = MeatBall<CStack, CTerminal, CStackPtrBox>;
+
+	// The pops of a missing transition.
+	static constexpr Id none = UINT32_MAX;
+
+	struct Action
+	{
+		Id target = 0;
+		Id pops = none;
+		Id pushBegin = 0, pushEnd = 0; // into `pushed`
+	};
+
+	// What the epsilon moves from a state and stack top come to.
+	enum class Settles
+	{
+		Reads, // there are none: the next move reads a char
+		Moves, // `action`, after which the path of the new top follows
+		Stuck  // no char is ever read again
+	};
+
+	struct Epsilon
+	{
+		Settles settles = Settles::Reads;
+		Action action{};
+		bool empties = false; // whether the stack is empty on the way
+	};
+
+	size_t states = 0, stackSymbols = 0, terminals = 0;
+	Id startState = 0;
+	std::vector<Id> initialStack{};
+
+	std::vector<Action> table{};    // [(state * (G + 1) + top) * (T + 1) + c]
+	std::vector<Epsilon> epsilon{}; // [state * (G + 1) + top]
+	std::vector<Id> pushed{};
+
+	// Chars of small alphabets are found by a scan, which beats hashing.
+	static constexpr size_t scanned = 16;
+	std::vector<std::pair<const CTerminal*, Id>> fewTerminals{};
+	std::unordered_map<const CTerminal*, Id> terminalIds{};
+
+	std::optional<Id> inputOf(const CTerminal* c) const
+	{
+		if (terminalIds.empty()) {
+			for (auto const& [known, id] : fewTerminals)
+				if (known == c) return id;
+			return std::nullopt;
+		}
+
+		auto found = terminalIds.find(c);
+		if (found == terminalIds.end()) return std::nullopt;
+		return found->second;
+	}
+
+	size_t configuration(Id state, Id top) const
+	{
+		return state * (stackSymbols + 1) + top;
+	}
+
+	size_t slot(Id state, Id top, Id input) const
+	{
+		return configuration(state, top) * (terminals + 1) + input;
+	}
+
+	Epsilon compose(Id state, Id top,
+	                std::vector<std::optional<Action>> const& moves);
+
+	/*
+	 * Follows the epsilon moves from a configuration. Returns false if the
+	 * run dies on the way or never reads again; sets `emptied` if the stack
+	 * is empty at some point.
+	 */
+	bool settle(Id& state, std::vector<Id>& stack, bool& emptied) const
+	{
+		const Id empty = static_cast<Id>(stackSymbols);
+
+		for (;;) {
+			if (stack.empty()) emptied = true;
+
+			Epsilon const& moves =
+			    epsilon[configuration(state, stack.empty() ? empty : stack.back())];
+			if (moves.empties) emptied = true;
+			if (moves.settles == Settles::Reads) return true;
+			if (moves.settles == Settles::Stuck) return false;
+
+			Action const& action = moves.action;
+			if (action.pops > stack.size()) return false;
+			stack.resize(stack.size() - action.pops);
+			stack.insert(stack.end(), pushed.begin() + action.pushBegin,
+			             pushed.begin() + action.pushEnd);
+			state = action.target;
+		}
+	}
+
+public:
+	// Epsilon moves followed from one state and top before the runner
+	// gives up on the automaton.
+	static constexpr size_t maxEpsilonMoves = 1 << 16;
+
+	/*
+	 * Throws std::logic_error if the automaton is not deterministic, or if
+	 * some path of epsilon moves is longer than maxEpsilonMoves.
+	 */
+	DeterministicRunner(
+	    std::forward_list<MeatBallT> const& meatBalls, MeatBallT const& start,
+	    std::shared_ptr<AlphabetLike<CStack, CStackPtrBox>> const& stackAlphabet,
+	    std::shared_ptr<AlphabetLike<CTerminal>> const& wordAlphabet,
+	    std::optional<CStack> bottom = std::nullopt)
+	{
+		if (!findConflicts(meatBalls).empty())
+			throw std::logic_error("The automaton is not deterministic.");
+
+		std::map<const MeatBallT*, Id> stateIds;
+		for (auto const& meatBall : meatBalls)
+			stateIds.emplace(&meatBall, static_cast<Id>(stateIds.size()));
+		states = stateIds.size();
+		startState = stateIds.at(&start);
+
+		std::map<CStack, Id> symbolIds;
+		std::map<CTerminal, Id> inputIds;
+		auto symbolOf = [&symbolIds](CStack const& c) {
+			return symbolIds.emplace(c, static_cast<Id>(symbolIds.size()))
+			    .first->second;
+		};
+
+		// The stack holds what the alphabet hands out for a char, which is
+		// what transitions compare the top with.
+		auto pushable = [&stackAlphabet](CStack const& c) -> std::optional<CStack> {
+			auto inAlphabet = stackAlphabet->findChar(c);
+			if (!inAlphabet) return std::nullopt;
+			return CStack{inAlphabet};
+		};
+
+		struct Pending
+		{
+			Id state;
+			std::optional<Id> top;
+			std::optional<Id> input; // none for an epsilon move
+			Action action;
+		};
+		std::vector<Pending> entries;
+
+		for (auto const& meatBall : meatBalls)
+			for (auto const& [from, to] : meatBall.transitions) {
+				if (to.empty()) continue;
+
+				auto const& [command, target] = to.front();
+				auto effect = command->effect();
+
+				Action action{stateIds.at(target), static_cast<Id>(effect.pops),
+				              static_cast<Id>(pushed.size()), 0};
+				bool possible = true;
+				for (auto const& c : effect.pushes) {
+					auto boxed = pushable(c);
+					if (!boxed) {
+						possible = false;
+						break;
+					}
+					pushed.push_back(symbolOf(*boxed));
+				}
+				if (!possible) { // the push would throw: the run dies here
+					pushed.resize(action.pushBegin);
+					continue;
+				}
+				action.pushEnd = static_cast<Id>(pushed.size());
+
+				std::optional<Id> top;
+				if (from.first) top = symbolOf(*from.first);
+				std::optional<Id> input;
+				if (from.second)
+					input = inputIds
+					            .emplace(*from.second,
+					                     static_cast<Id>(inputIds.size()))
+					            .first->second;
+
+				entries.push_back({stateIds.at(&meatBall), top, input, action});
+			}
+
+		if (bottom) {
+			if (auto boxed = pushable(*bottom))
+				initialStack.push_back(symbolOf(*boxed));
+			else
+				throw std::invalid_argument(
+				    "The stack bottom is not in the stack alphabet.");
+		}
+
+		stackSymbols = symbolIds.size();
+		terminals = inputIds.size();
+		const Id empty = static_cast<Id>(stackSymbols);
+
+		table.assign(states * (stackSymbols + 1) * (terminals + 1), Action{});
+		std::vector<std::optional<Action>> moves(states * (stackSymbols + 1));
+		for (auto const& entry : entries) {
+			const Id top = entry.top.value_or(empty);
+			if (entry.input)
+				table[slot(entry.state, top, *entry.input)] = entry.action;
+			else
+				moves[configuration(entry.state, top)] = entry.action;
+		}
+
+		epsilon.reserve(moves.size());
+		for (Id state = 0; state < states; ++state)
+			for (Id top = 0; top <= empty; ++top)
+				epsilon.push_back(compose(state, top, moves));
+
+		// Chars that no transition reads share the last column, which stays
+		// empty.
+		wordAlphabet->for_each([&](CTerminal const& c) {
+			auto found = inputIds.find(c);
+			fewTerminals.emplace_back(&c, found == inputIds.end()
+			                                  ? static_cast<Id>(terminals)
+			                                  : found->second);
+		});
+		if (fewTerminals.size() > scanned)
+			terminalIds.insert(fewTerminals.begin(), fewTerminals.end());
+	}
+
+	bool recognize(AlphaString<CTerminal> const& word) const
+	{
+		std::vector<Id> stack{initialStack};
+		stack.reserve(word.string.size() + initialStack.size());
+		Id state = startState;
+		const Id empty = static_cast<Id>(stackSymbols);
+		bool emptied = false;
+
+		for (const CTerminal* c : word.string) {
+			auto input = inputOf(c);
+			if (!input || !settle(state, stack, emptied)) return false;
+
+			const Id top = stack.empty() ? empty : stack.back();
+			Action const& action = table[slot(state, top, *input)];
+			if (action.pops > stack.size()) return false; // none included
+			stack.resize(stack.size() - action.pops);
+			for (Id i = action.pushBegin; i < action.pushEnd; ++i)
+				stack.push_back(pushed[i]);
+			state = action.target;
+		}
+
+		emptied = false;
+		settle(state, stack, emptied);
+		return emptied;
+	}
+};
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox>
+auto DeterministicRunner<CStack, CTerminal, CStackPtrBox>::compose(
+    Id state, Id top, std::vector<std::optional<Action>> const& moves) -> Epsilon
+{
+	/*
+	 * The path is followed symbolically from a stack with `top` on top: it
+	 * pops `pops` chars of the real stack and leaves `above` on it. `kept`
+	 * holds the configurations on the way that the stack has not sunk below
+	 * since, by state, top and height. Moves since such a configuration
+	 * only looked at its top and what they pushed themselves, so meeting
+	 * its state and top again, no lower, repeats them forever.
+	 */
+	struct Kept
+	{
+		Id state, top;
+		std::ptrdiff_t height;
+	};
+
+	const Id empty = static_cast<Id>(stackSymbols);
+	Epsilon composed;
+	Id pops = 0;
+	std::vector<Id> above;
+	std::vector<Kept> kept{{state, top, 0}};
+
+	for (size_t moved = 0;; ++moved) {
+		auto const& move =
+		    moves[configuration(state, above.empty() ? top : above.back())];
+		if (!move) {
+			if (moved) composed.settles = Settles::Moves;
+			break;
+		}
+		if (moved == maxEpsilonMoves)
+			throw std::logic_error("The automaton has a path of epsilon moves "
+			                       "too long to compose.");
+
+		const size_t fromAbove = std::min<size_t>(move->pops, above.size());
+		const bool popsTop = move->pops > fromAbove;
+		above.resize(above.size() - fromAbove);
+		if (popsTop && top == empty) { // pops an empty stack
+			composed.settles = Settles::Stuck;
+			break;
+		}
+		pops += static_cast<Id>(move->pops - fromAbove);
+		above.insert(above.end(), pushed.begin() + move->pushBegin,
+		             pushed.begin() + move->pushEnd);
+		state = move->target;
+
+		const auto height = static_cast<std::ptrdiff_t>(above.size()) -
+		                    static_cast<std::ptrdiff_t>(pops);
+		while (!kept.empty() && kept.back().height > height)
+			kept.pop_back();
+
+		if (above.empty() && pops) { // the stack below decides how to go on
+			composed.settles = Settles::Moves;
+			break;
+		}
+		if (above.empty() && top == empty) composed.empties = true;
+
+		const Id reached = above.empty() ? top : above.back();
+		if (std::any_of(kept.begin(), kept.end(), [&](Kept const& earlier) {
+			    return earlier.state == state && earlier.top == reached;
+		    })) {
+			composed.settles = Settles::Stuck;
+			break;
+		}
+		kept.push_back({state, reached, height});
+	}
+
+	if (composed.settles == Settles::Moves) {
+		composed.action = {state, pops, static_cast<Id>(pushed.size()), 0};
+		pushed.insert(pushed.end(), above.begin(), above.end());
+		composed.action.pushEnd = static_cast<Id>(pushed.size());
+	}
+	return composed;
+}
+
+} // namespace context_free
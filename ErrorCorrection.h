@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <tuple>
+#include <vector>
+
+#include "CNFGrammar.h"
+#include "ChartRecognizer.h"
+
+namespace context_free {
+
+class LeastErrorsRecognizer
+{
+	/*
+	 * Finds a word of the language closest to a given one, counting
+	 * insertions, deletions and substitutions of single terminals, in the
+	 * spirit of Aho and Peterson's least-errors parser. The chart holds, for
+	 * every span [i, j) and nonterminal A, the fewest edits that turn some
+	 * word A derives into the span:
+	 *
+	 *  - A -> a covers a span of length L with L - 1 deletions, plus a
+	 *    substitution unless a occurs in it, or an empty span with an
+	 *    insertion,
+	 *  - A -> BC covers [i, j) split anywhere in [i, j]; an empty half costs
+	 *    the insertion of the shortest word its nonterminal derives.
+	 *
+	 * Spans whose cost exceeds a bound are left out of the chart. The bound
+	 * starts at 1 and doubles until it covers the answer, so a word with few
+	 * errors costs little more than recognizing it; a correct word is only
+	 * recognized, by a ChartRecognizer.
+	 */
+public:
+	using Cost = std::uint32_t;
+
+	struct Correction
+	{
+		size_t errors;
+		std::vector<Symbol> word; // the nearest word in the language
+	};
+
+	const CNFGrammar& grammar;
+
+private:
+	static constexpr Cost infinite = UINT32_MAX;
+
+	struct Use
+	{
+		Symbol from, other;
+		std::uint32_t rule;
+	};
+
+	// How a nonterminal covers a span: a terminal rule, or a binary rule
+	// with its split point.
+	struct Entry
+	{
+		Symbol symbol;
+		Cost cost;
+		std::uint32_t rule;
+		bool binary;
+		std::uint32_t split;
+	};
+
+	const ChartRecognizer exact;
+	std::vector<std::vector<Use>> asLeft{}, asRight{};
+	std::vector<std::vector<std::uint32_t>> byTerminal{};
+
+	// The shortest word of every nonterminal: its length and the rule that
+	// starts it.
+	std::vector<Cost> shortest{};
+	std::vector<std::optional<std::pair<bool, std::uint32_t>>> shortestRule{};
+
+	static Cost add(Cost a, Cost b)
+	{
+		return a >= infinite - b ? infinite : a + b;
+	}
+
+	void appendShortest(Symbol A, std::vector<Symbol>& word) const
+	{
+		std::vector<Symbol> open{A};
+		while (!open.empty()) {
+			const Symbol B = open.back();
+			open.pop_back();
+
+			auto [binary, rule] = *shortestRule[B];
+			if (!binary) {
+				word.push_back(grammar.terminalRules[rule].terminal);
+				continue;
+			}
+			open.push_back(grammar.binaryRules[rule].right);
+			open.push_back(grammar.binaryRules[rule].left);
+		}
+	}
+
+	class Chart
+	{
+		const size_t n;
+		std::vector<std::vector<Entry>> cells;
+
+	public:
+		explicit Chart(size_t n) : n(n), cells((n + 1) * (n + 1)) {}
+
+		std::vector<Entry>& at(size_t i, size_t j) { return cells[i * (n + 1) + j]; }
+
+		std::vector<Entry> const& at(size_t i, size_t j) const
+		{
+			return cells[i * (n + 1) + j];
+		}
+
+		// Cells are sorted by symbol once filled.
+		Entry const* find(size_t i, size_t j, Symbol A) const
+		{
+			auto const& cell = at(i, j);
+			auto found = std::lower_bound(
+			    cell.begin(), cell.end(), A,
+			    [](Entry const& e, Symbol s) { return e.symbol < s; });
+			return found != cell.end() && found->symbol == A ? &*found : nullptr;
+		}
+	};
+
+	/*
+	 * The chart of every span within `bound` edits.
+	 */
+	Chart fill(std::vector<Symbol> const& word, Cost bound) const
+	{
+		const size_t n = word.size(), N = grammar.nonterminalCount();
+		Chart chart{n};
+
+		std::vector<Entry> best(N, Entry{0, infinite, 0, false, 0});
+		std::vector<Cost> right(N, infinite);
+		std::vector<Symbol> touched;
+
+		using Queued = std::pair<Cost, Symbol>;
+		std::priority_queue<Queued, std::vector<Queued>, std::greater<Queued>> queue;
+
+		auto relax = [&](Entry entry) {
+			if (entry.cost > bound) return;
+			Entry& current = best[entry.symbol];
+			if (current.cost == infinite) touched.push_back(entry.symbol);
+			else if (current.cost <= entry.cost) return;
+			current = entry;
+			queue.emplace(entry.cost, entry.symbol);
+		};
+
+		for (size_t length = 1; length <= n; ++length)
+			for (size_t i = 0; i + length <= n; ++i) {
+				const size_t j = i + length;
+				const Cost deletions = static_cast<Cost>(length - 1);
+
+				if (deletions <= bound) {
+					for (std::uint32_t r = 0; r < grammar.terminalRules.size(); ++r)
+						relax({grammar.terminalRules[r].from, deletions + 1, r, false, 0});
+					for (size_t p = i; p < j; ++p)
+						for (std::uint32_t r : byTerminal[word[p]])
+							relax({grammar.terminalRules[r].from, deletions, r, false, 0});
+				}
+
+				for (size_t k = i + 1; k < j; ++k) {
+					auto const& leftCell = chart.at(i, k);
+					auto const& rightCell = chart.at(k, j);
+					if (leftCell.empty() || rightCell.empty()) continue;
+
+					for (auto const& entry : rightCell)
+						right[entry.symbol] = entry.cost;
+					for (auto const& entry : leftCell)
+						for (auto const& use : asLeft[entry.symbol])
+							if (right[use.other] != infinite)
+								relax({use.from, add(entry.cost, right[use.other]),
+								       use.rule, true, static_cast<std::uint32_t>(k)});
+					for (auto const& entry : rightCell)
+						right[entry.symbol] = infinite;
+				}
+
+				// An empty half: the other one covers the whole span, which
+				// is settled cheapest first.
+				while (!queue.empty()) {
+					auto [cost, B] = queue.top();
+					queue.pop();
+					if (best[B].cost != cost) continue;
+
+					for (auto const& use : asLeft[B])
+						relax({use.from, add(cost, shortest[use.other]), use.rule,
+						       true, static_cast<std::uint32_t>(j)});
+					for (auto const& use : asRight[B])
+						relax({use.from, add(shortest[use.other], cost), use.rule,
+						       true, static_cast<std::uint32_t>(i)});
+				}
+
+				auto& cell = chart.at(i, j);
+				std::sort(touched.begin(), touched.end());
+				for (Symbol A : touched) {
+					cell.push_back(best[A]);
+					best[A].cost = infinite;
+				}
+				touched.clear();
+			}
+
+		return chart;
+	}
+
+	std::vector<Symbol> derived(Chart const& chart, size_t n) const
+	{
+		std::vector<Symbol> word;
+		std::vector<std::tuple<Symbol, size_t, size_t>> open{{grammar.start, 0, n}};
+
+		while (!open.empty()) {
+			auto [A, i, j] = open.back();
+			open.pop_back();
+
+			if (i == j) {
+				appendShortest(A, word);
+				continue;
+			}
+
+			Entry const& entry = *chart.find(i, j, A);
+			if (!entry.binary) {
+				word.push_back(grammar.terminalRules[entry.rule].terminal);
+				continue;
+			}
+			auto const& rule = grammar.binaryRules[entry.rule];
+			open.emplace_back(rule.right, entry.split, j);
+			open.emplace_back(rule.left, i, entry.split);
+		}
+
+		return word;
+	}
+
+public:
+	LeastErrorsRecognizer(CNFGrammar const& grammar)
+	    : grammar(grammar), exact(grammar), asLeft(grammar.nonterminalCount()),
+	      asRight(grammar.nonterminalCount()),
+	      byTerminal(grammar.terminalCount()),
+	      shortest(grammar.nonterminalCount(), infinite),
+	      shortestRule(grammar.nonterminalCount())
+	{
+		for (std::uint32_t r = 0; r < grammar.binaryRules.size(); ++r) {
+			auto const& rule = grammar.binaryRules[r];
+			asLeft[rule.left].push_back({rule.from, rule.right, r});
+			asRight[rule.right].push_back({rule.from, rule.left, r});
+		}
+
+		for (std::uint32_t r = 0; r < grammar.terminalRules.size(); ++r) {
+			auto const& rule = grammar.terminalRules[r];
+			byTerminal[rule.terminal].push_back(r);
+			if (shortest[rule.from] > 1) {
+				shortest[rule.from] = 1;
+				shortestRule[rule.from] = {false, r};
+			}
+		}
+
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (std::uint32_t r = 0; r < grammar.binaryRules.size(); ++r) {
+				auto const& rule = grammar.binaryRules[r];
+				const Cost length = add(shortest[rule.left], shortest[rule.right]);
+				if (length < shortest[rule.from]) {
+					shortest[rule.from] = length;
+					shortestRule[rule.from] = {true, r};
+					changed = true;
+				}
+			}
+		}
+	}
+
+	LeastErrorsRecognizer(LeastErrorsRecognizer const&) = delete;
+
+	/*
+	 * The fewest edits that make the word one of the language, and the word
+	 * they make; nothing if the language is empty or more than `maxErrors`
+	 * edits are needed.
+	 */
+	std::optional<Correction> correct(std::vector<Symbol> const& word,
+	                                  size_t maxErrors = SIZE_MAX) const
+	{
+		const size_t n = word.size();
+
+		// Deleting the whole word, then inserting a shortest one, always
+		// works; no answer costs more.
+		size_t worst = grammar.acceptsEmpty()
+		                   ? n
+		                   : shortest[grammar.start] == infinite
+		                         ? SIZE_MAX
+		                         : n + shortest[grammar.start];
+		if (worst == SIZE_MAX) return std::nullopt;
+
+		if (exact.recognize(word)) return Correction{0, word};
+		if (n == 0) {
+			if (worst > maxErrors) return std::nullopt;
+			std::vector<Symbol> nearest;
+			appendShortest(grammar.start, nearest);
+			return Correction{worst, nearest};
+		}
+
+		const size_t limit = std::min(worst, maxErrors);
+		if (limit == 0) return std::nullopt;
+		for (size_t bound = 1;; bound = std::min(bound * 2, limit)) {
+			Chart chart = fill(word, static_cast<Cost>(std::min<size_t>(bound, infinite - 1)));
+
+			if (auto const* entry = chart.find(0, n, grammar.start)) {
+				if (grammar.acceptsEmpty() && n <= entry->cost)
+					return Correction{n, {}};
+				return Correction{entry->cost, derived(chart, n)};
+			}
+			if (bound >= limit) break;
+		}
+
+		if (grammar.acceptsEmpty() && n <= maxErrors) return Correction{n, {}};
+		return std::nullopt;
+	}
+};
+
+} // namespace context_free
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace context_free {
+
+/*
+ * Exploration strategies for ReadState. A strategy holds its parameters and
+ * names the frontier class that keeps the heads still to be expanded. Every
+ * head is pushed together with the number of chars it has consumed and the
+ * size of its stack; push() tells whether the head was kept.
+ */
+
+struct BreadthFirst
+{
+	/*
+	 * Heads that have read less come first, so the shortest accepting runs
+	 * are found first. Memory grows with the width of the search.
+	 */
+	template <typename Head> class Frontier
+	{
+		std::vector<std::deque<Head>> byPosition{};
+		size_t lowest = 0, count = 0;
+
+	public:
+		explicit Frontier(BreadthFirst) {}
+
+		bool push(Head&& head, size_t consumed, size_t)
+		{
+			if (byPosition.size() <= consumed) byPosition.resize(consumed + 1);
+			byPosition[consumed].push_back(std::move(head));
+			lowest = std::min(lowest, consumed);
+			++count;
+			return true;
+		}
+
+		Head pop()
+		{
+			while (byPosition[lowest].empty())
+				++lowest;
+
+			Head head = std::move(byPosition[lowest].front());
+			byPosition[lowest].pop_front();
+			--count;
+			return head;
+		}
+
+		void clear()
+		{
+			byPosition.clear();
+			lowest = count = 0;
+		}
+
+		bool empty() const { return count == 0; }
+		size_t size() const { return count; }
+		size_t dropped() const { return 0; }
+	};
+};
+
+struct DepthFirst
+{
+	/*
+	 * The newest head comes first, so one run is followed to its end before
+	 * the next is tried. At most `limit` heads are kept; further ones are
+	 * dropped, which bounds the memory but may lose accepting runs.
+	 */
+	size_t limit = size_t{1} << 16;
+
+	template <typename Head> class Frontier
+	{
+		std::vector<Head> heads{};
+		const size_t limit;
+		size_t lost = 0;
+
+	public:
+		explicit Frontier(DepthFirst strategy) : limit(strategy.limit)
+		{
+			if (limit == 0)
+				throw std::invalid_argument("A depth-first frontier needs "
+				                            "room for at least one head.");
+		}
+
+		bool push(Head&& head, size_t, size_t)
+		{
+			if (heads.size() == limit) {
+				++lost;
+				return false;
+			}
+			heads.push_back(std::move(head));
+			return true;
+		}
+
+		Head pop()
+		{
+			Head head = std::move(heads.back());
+			heads.pop_back();
+			return head;
+		}
+
+		void clear() { heads.clear(); }
+
+		bool empty() const { return heads.empty(); }
+		size_t size() const { return heads.size(); }
+		size_t dropped() const { return lost; }
+	};
+};
+
+struct BestFirst
+{
+	/*
+	 * The head with the most input consumed and the least on its stack comes
+	 * first: the priority is consumed chars minus stack size. Heads of equal
+	 * priority are taken oldest first.
+	 */
+	template <typename Head> class Frontier
+	{
+		struct Entry
+		{
+			std::int64_t priority;
+			std::uint64_t serial;
+			Head head;
+		};
+
+		static bool later(Entry const& a, Entry const& b)
+		{
+			if (a.priority != b.priority) return a.priority < b.priority;
+			return a.serial > b.serial;
+		}
+
+		std::vector<Entry> heap{};
+		std::uint64_t nextSerial = 0;
+
+	public:
+		explicit Frontier(BestFirst) {}
+
+		bool push(Head&& head, size_t consumed, size_t stackSize)
+		{
+			heap.push_back({static_cast<std::int64_t>(consumed) -
+			                    static_cast<std::int64_t>(stackSize),
+			                nextSerial++, std::move(head)});
+			std::push_heap(heap.begin(), heap.end(), later);
+			return true;
+		}
+
+		Head pop()
+		{
+			std::pop_heap(heap.begin(), heap.end(), later);
+			Head head = std::move(heap.back().head);
+			heap.pop_back();
+			return head;
+		}
+
+		void clear() { heap.clear(); }
+
+		bool empty() const { return heap.empty(); }
+		size_t size() const { return heap.size(); }
+		size_t dropped() const { return 0; }
+	};
+};
+
+} // namespace context_free
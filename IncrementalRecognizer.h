@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class IncrementalRecognizer
+{
+	/*
+	 * An Earley recognizer that keeps its item sets (one column per position
+	 * of the word) across edits of the word. An edit rebuilds the columns
+	 * from the edit onwards, but only until a rebuilt column equals the old
+	 * one at the same place in the text and no item in either refers back
+	 * into the edited region. Every later column is then known to be
+	 * unchanged and is kept. For an edit inside a construct that closes
+	 * soon after, the work is proportional to the edit, not to the word.
+	 *
+	 * Items name their origin column by id rather than by position, so kept
+	 * columns stay valid when the positions after an edit shift.
+	 *
+	 * Epsilon rules are handled as by Aycock and Horspool: predicting a
+	 * nullable nonterminal also steps over it.
+	 */
+	using ColumnId = std::uint32_t;
+
+	struct Item
+	{
+		std::uint32_t dotted; // the rule and the position of the dot in it
+		ColumnId origin;
+	};
+
+	struct Column
+	{
+		std::vector<Item> items{};
+		// (nonterminal after the dot, item index), sorted
+		std::vector<std::pair<Symbol, std::uint32_t>> waiting{};
+		// Marks columns that are being replaced during an edit.
+		bool replaced = false;
+	};
+
+public:
+	const IndexedGrammar& grammar;
+
+private:
+	// A rule with right-hand side of length k owns k + 1 consecutive dotted
+	// positions; these tables are indexed by dotted position.
+	std::vector<IndexedSymbol> afterDot{};
+	std::vector<std::uint8_t> complete{};
+	std::vector<Symbol> ruleFrom{};
+
+	std::vector<std::vector<std::uint32_t>> predictions{};
+	std::vector<std::uint8_t> nullable{};
+	std::unordered_map<const Char*, Symbol> terminalIds{};
+
+	std::vector<Symbol> symbols{};
+	std::vector<Column> columns{};
+	std::vector<ColumnId> unused{};
+	std::vector<ColumnId> order{}; // the column at each position 0..size()
+
+	std::unordered_set<std::uint64_t> seen{};
+	size_t rebuilt = 0;
+
+public:
+	IncrementalRecognizer(IndexedGrammar const& grammar,
+	                      std::vector<Symbol> word = {})
+	    : grammar(grammar), predictions(grammar.nonterminals.size()),
+	      nullable(grammar.nonterminals.size(), 0), symbols(std::move(word))
+	{
+		for (auto const& rule : grammar.rules) {
+			predictions[rule.from].push_back(
+			    static_cast<std::uint32_t>(afterDot.size()));
+			for (auto const& symbol : rule.to) {
+				afterDot.push_back(symbol);
+				complete.push_back(0);
+				ruleFrom.push_back(rule.from);
+			}
+			afterDot.push_back({});
+			complete.push_back(1);
+			ruleFrom.push_back(rule.from);
+		}
+
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (auto const& rule : grammar.rules) {
+				if (nullable[rule.from]) continue;
+				if (std::all_of(rule.to.begin(), rule.to.end(),
+				                [this](IndexedSymbol s) {
+					                return !s.terminal && nullable[s.id];
+				                }))
+					nullable[rule.from] = changed = true;
+			}
+		}
+
+		for (size_t t = 0; t < grammar.terminals.size(); ++t)
+			terminalIds[grammar.terminals[t]] = static_cast<Symbol>(t);
+
+		for (Symbol t : symbols)
+			if (t >= grammar.terminals.size())
+				throw std::invalid_argument("Unknown terminal id in the word.");
+
+		order.push_back(allocate());
+		build(order.back(), nullptr, 0);
+		for (size_t j = 1; j <= symbols.size(); ++j) {
+			order.push_back(allocate());
+			build(order[j], &order[j - 1], symbols[j - 1]);
+		}
+	}
+
+	IncrementalRecognizer(IncrementalRecognizer const&) = delete;
+
+	size_t size() const { return symbols.size(); }
+
+	std::vector<Symbol> const& word() const { return symbols; }
+
+	// The number of columns the last edit had to build.
+	size_t columnsRebuilt() const { return rebuilt; }
+
+	template <typename C>
+	std::vector<Symbol> encode(AlphaString<C> const& word) const
+	{
+		std::vector<Symbol> encoded;
+		encoded.reserve(word.string.size());
+
+		for (const C* c : word.string) {
+			auto found = terminalIds.find(c);
+			if (found == terminalIds.end())
+				throw std::invalid_argument(
+				    "The word contains a char that is not a terminal.");
+			encoded.push_back(found->second);
+		}
+
+		return encoded;
+	}
+
+	bool accepted() const
+	{
+		for (auto const& item : columns[order.back()].items)
+			if (complete[item.dotted] && ruleFrom[item.dotted] == grammar.start &&
+			    item.origin == order.front())
+				return true;
+		return false;
+	}
+
+	/*
+	 * Replaces the `erased` symbols starting at `position` with `inserted`.
+	 */
+	void replace(size_t position, size_t erased,
+	             std::vector<Symbol> const& inserted)
+	{
+		if (position > size() || erased > size() - position)
+			throw std::out_of_range("The edit lies outside of the word.");
+		for (Symbol t : inserted)
+			if (t >= grammar.terminals.size())
+				throw std::invalid_argument("Unknown terminal id in the word.");
+
+		rebuilt = 0;
+		if (!erased && inserted.empty()) return;
+
+		const size_t p = position, m = inserted.size();
+		const size_t oldSize = size();
+		symbols.erase(symbols.begin() + static_cast<std::ptrdiff_t>(p),
+		              symbols.begin() + static_cast<std::ptrdiff_t>(p + erased));
+		symbols.insert(symbols.begin() + static_cast<std::ptrdiff_t>(p),
+		               inserted.begin(), inserted.end());
+
+		std::vector<ColumnId> fresh;
+		size_t markedUpTo = p + 1; // old columns (p, markedUpTo) are marked
+
+		for (size_t j = p + 1; j <= size(); ++j) {
+			ColumnId id = allocate();
+			columns[id].replaced = true;
+			build(id, fresh.empty() ? &order[p] : &fresh.back(),
+			      symbols[j - 1]);
+			fresh.push_back(id);
+			++rebuilt;
+
+			// The old column at the same place in the text, if any.
+			if (j < p + m || j + erased - m <= p) continue;
+			const size_t old = j + erased - m;
+
+			for (; markedUpTo < old; ++markedUpTo)
+				columns[order[markedUpTo]].replaced = true;
+
+			if (!sameColumns(id, order[old])) continue;
+
+			fresh.pop_back();
+			release(id);
+			splice(p, old, fresh);
+			return;
+		}
+
+		splice(p, oldSize + 1, fresh);
+	}
+
+	void insert(size_t position, std::vector<Symbol> const& inserted)
+	{
+		replace(position, 0, inserted);
+	}
+
+	void erase(size_t position, size_t count) { replace(position, count, {}); }
+
+private:
+	ColumnId allocate()
+	{
+		if (unused.empty()) {
+			columns.emplace_back();
+			return static_cast<ColumnId>(columns.size() - 1);
+		}
+
+		ColumnId id = unused.back();
+		unused.pop_back();
+		return id;
+	}
+
+	void release(ColumnId id)
+	{
+		columns[id].items.clear();
+		columns[id].waiting.clear();
+		columns[id].replaced = false;
+		unused.push_back(id);
+	}
+
+	/*
+	 * Replaces the old columns at positions (p, oldEnd) with `fresh`.
+	 */
+	void splice(size_t p, size_t oldEnd, std::vector<ColumnId> const& fresh)
+	{
+		for (size_t i = p + 1; i < oldEnd; ++i)
+			release(order[i]);
+
+		order.erase(order.begin() + static_cast<std::ptrdiff_t>(p + 1),
+		            order.begin() + static_cast<std::ptrdiff_t>(oldEnd));
+		order.insert(order.begin() + static_cast<std::ptrdiff_t>(p + 1),
+		             fresh.begin(), fresh.end());
+
+		for (ColumnId id : fresh)
+			columns[id].replaced = false;
+	}
+
+	/*
+	 * Whether a rebuilt column can stand in for an old one: same items, and
+	 * all of them started either before the edit or in the column itself.
+	 */
+	bool sameColumns(ColumnId rebuiltId, ColumnId oldId) const
+	{
+		auto const& a = columns[rebuiltId].items;
+		auto const& b = columns[oldId].items;
+		if (a.size() != b.size()) return false;
+
+		auto keys = [this](std::vector<Item> const& items, ColumnId self,
+		                   std::vector<std::uint64_t>& out) {
+			for (auto const& item : items) {
+				if (item.origin != self && columns[item.origin].replaced)
+					return false;
+				std::uint64_t origin = item.origin == self ? UINT32_MAX : item.origin;
+				out.push_back(std::uint64_t{item.dotted} << 32 | origin);
+			}
+			std::sort(out.begin(), out.end());
+			return true;
+		};
+
+		std::vector<std::uint64_t> keysA, keysB;
+		return keys(a, rebuiltId, keysA) && keys(b, oldId, keysB) &&
+		       keysA == keysB;
+	}
+
+	/*
+	 * Fills column `id` by scanning `scanned` from the previous column (or
+	 * predicting the start symbol if there is none) and closing the result
+	 * under prediction and completion.
+	 */
+	void build(ColumnId id, const ColumnId* previous, Symbol scanned)
+	{
+		seen.clear();
+		std::vector<Item> items;
+
+		auto add = [&](std::uint32_t dotted, ColumnId origin) {
+			if (seen.insert(std::uint64_t{dotted} << 32 | origin).second)
+				items.push_back({dotted, origin});
+		};
+
+		if (previous) {
+			for (auto const& item : columns[*previous].items) {
+				auto const& next = afterDot[item.dotted];
+				if (!complete[item.dotted] && next.terminal && next.id == scanned)
+					add(item.dotted + 1, item.origin);
+			}
+		} else {
+			for (std::uint32_t dotted : predictions[grammar.start])
+				add(dotted, id);
+		}
+
+		for (size_t i = 0; i < items.size(); ++i) {
+			const Item item = items[i];
+
+			if (complete[item.dotted]) {
+				// Empty completions were taken care of when predicting.
+				if (item.origin == id) continue;
+
+				auto const& from = columns[item.origin];
+				auto range = std::equal_range(
+				    from.waiting.begin(), from.waiting.end(),
+				    std::make_pair(ruleFrom[item.dotted], std::uint32_t{0}),
+				    [](auto const& x, auto const& y) { return x.first < y.first; });
+				for (auto at = range.first; at != range.second; ++at) {
+					auto const& waiting = from.items[at->second];
+					add(waiting.dotted + 1, waiting.origin);
+				}
+				continue;
+			}
+
+			auto const& next = afterDot[item.dotted];
+			if (next.terminal) continue;
+
+			for (std::uint32_t dotted : predictions[next.id])
+				add(dotted, id);
+			if (nullable[next.id]) add(item.dotted + 1, item.origin);
+		}
+
+		Column& column = columns[id];
+		column.items = std::move(items);
+		column.waiting.clear();
+		for (size_t i = 0; i < column.items.size(); ++i) {
+			std::uint32_t dotted = column.items[i].dotted;
+			if (!complete[dotted] && !afterDot[dotted].terminal)
+				column.waiting.emplace_back(afterDot[dotted].id,
+				                            static_cast<std::uint32_t>(i));
+		}
+		std::sort(column.waiting.begin(), column.waiting.end());
+	}
+};
+
+} // namespace context_free
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "BigUnsigned.h"
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class LanguageCounter
+{
+	/*
+	 * counts[length][A] is the number of derivations A =>* w with |w| ==
+	 * length. For an unambiguous grammar that is also the number of words.
+	 */
+	const CNFGrammar& grammar;
+
+	std::vector<std::vector<BigUnsigned>> counts{};
+
+	std::vector<std::vector<size_t>> binaryFrom{};
+	std::vector<std::vector<size_t>> terminalFrom{};
+
+public:
+	LanguageCounter(CNFGrammar const& grammar, size_t maxLength)
+	    : grammar(grammar),
+	      counts(maxLength + 1,
+	             std::vector<BigUnsigned>(grammar.nonterminalCount())),
+	      binaryFrom(grammar.nonterminalCount()),
+	      terminalFrom(grammar.nonterminalCount())
+	{
+		for (size_t i = 0; i < grammar.binaryRules.size(); ++i)
+			binaryFrom[grammar.binaryRules[i].from].push_back(i);
+		for (size_t i = 0; i < grammar.terminalRules.size(); ++i)
+			terminalFrom[grammar.terminalRules[i].from].push_back(i);
+
+		if (maxLength >= 1)
+			for (auto const& rule : grammar.terminalRules)
+				counts[1][rule.from] += rule.multiplicity;
+
+		for (size_t length = 2; length <= maxLength; ++length) {
+			for (auto const& rule : grammar.binaryRules) {
+				BigUnsigned sum;
+				for (size_t k = 1; k < length; ++k) {
+					auto const& left = counts[k][rule.left];
+					auto const& right = counts[length - k][rule.right];
+					if (!left.isZero() && !right.isZero()) sum += left * right;
+				}
+				if (!sum.isZero())
+					counts[length][rule.from] += sum * rule.multiplicity;
+			}
+		}
+	}
+
+	LanguageCounter(LanguageCounter const&) = delete;
+
+	CNFGrammar const& cnf() const { return grammar; }
+
+	size_t maxLength() const { return counts.size() - 1; }
+
+	BigUnsigned derivations(Symbol A, size_t length) const
+	{
+		if (length == 0)
+			return A == grammar.start ? grammar.empty.multiplicity : 0;
+		return counts.at(length)[A];
+	}
+
+	BigUnsigned derivations(size_t length) const
+	{
+		return derivations(grammar.start, length);
+	}
+
+	BigUnsigned derivationsUpTo(size_t maxLength) const
+	{
+		BigUnsigned sum;
+		for (size_t length = 0; length <= maxLength; ++length)
+			sum += derivations(length);
+		return sum;
+	}
+
+	std::vector<size_t> const& binaryRulesFrom(Symbol A) const
+	{
+		return binaryFrom[A];
+	}
+
+	std::vector<size_t> const& terminalRulesFrom(Symbol A) const
+	{
+		return terminalFrom[A];
+	}
+
+	/*
+	 * Appends the yield of the index-th derivation of length `length` from A,
+	 * where 0 <= index < derivations(A, length). Derivations are ordered by
+	 * rule, then by split point, then left part before right part.
+	 */
+	void unrank(Symbol A, size_t length, BigUnsigned index,
+	            std::vector<Symbol>& word) const
+	{
+		if (length == 0) return;
+
+		if (length == 1) {
+			for (size_t i : terminalFrom[A]) {
+				auto const& rule = grammar.terminalRules[i];
+				BigUnsigned block{rule.multiplicity};
+				if (index < block) {
+					word.push_back(rule.terminal);
+					return;
+				}
+				index -= block;
+			}
+			throw std::out_of_range("Derivation index out of range.");
+		}
+
+		for (size_t i : binaryFrom[A]) {
+			auto const& rule = grammar.binaryRules[i];
+			for (size_t k = 1; k < length; ++k) {
+				auto const& left = counts[k][rule.left];
+				auto const& right = counts[length - k][rule.right];
+				if (left.isZero() || right.isZero()) continue;
+
+				BigUnsigned pairs = left * right;
+				BigUnsigned block = pairs * rule.multiplicity;
+				if (!(index < block)) {
+					index -= block;
+					continue;
+				}
+
+				BigUnsigned copy, pair, leftIndex, rightIndex;
+				BigUnsigned::divmod(index, pairs, copy, pair);
+				BigUnsigned::divmod(pair, right, leftIndex, rightIndex);
+
+				unrank(rule.left, k, leftIndex, word);
+				unrank(rule.right, length - k, rightIndex, word);
+				return;
+			}
+		}
+
+		throw std::out_of_range("Derivation index out of range.");
+	}
+
+	/*
+	 * The number of distinct words of the given length. Exact, but it walks
+	 * every derivation, so use derivations() when the grammar is known to be
+	 * unambiguous.
+	 */
+	BigUnsigned distinctWords(size_t length) const;
+};
+
+class LanguageEnumerator
+{
+	/*
+	 * Lazily lists the words of the language in order of length, up to the
+	 * counter's maximum length. Without `distinct` every derivation yields
+	 * its word once, so ambiguous words repeat.
+	 */
+	const LanguageCounter& counter;
+	const bool distinct;
+
+	size_t length = 0;
+	BigUnsigned index{};
+	std::unordered_set<std::string> seen{};
+
+	static std::string key(std::vector<Symbol> const& word)
+	{
+		return {reinterpret_cast<const char*>(word.data()),
+		        word.size() * sizeof(Symbol)};
+	}
+
+public:
+	LanguageEnumerator(LanguageCounter const& counter, bool distinct = true)
+	    : counter(counter), distinct(distinct)
+	{
+	}
+
+	std::optional<std::vector<Symbol>> next()
+	{
+		while (length <= counter.maxLength()) {
+			if (!(index < counter.derivations(length))) {
+				++length;
+				index = {};
+				seen.clear();
+				continue;
+			}
+
+			std::vector<Symbol> word;
+			counter.unrank(counter.cnf().start, length, index, word);
+			index += 1;
+
+			if (distinct && !seen.insert(key(word)).second) continue;
+
+			return word;
+		}
+
+		return std::nullopt;
+	}
+};
+
+inline BigUnsigned LanguageCounter::distinctWords(size_t length) const
+{
+	std::unordered_set<std::string> words;
+	BigUnsigned total = derivations(length);
+
+	for (BigUnsigned i; i < total; i += 1) {
+		std::vector<Symbol> word;
+		unrank(grammar.start, length, i, word);
+		words.emplace(reinterpret_cast<const char*>(word.data()),
+		              word.size() * sizeof(Symbol));
+	}
+
+	return words.size();
+}
+
+struct SplitMix64
+{
+	/*
+	 * A small and fast generator, good enough for producing test corpora.
+	 */
+	using result_type = std::uint64_t;
+
+	std::uint64_t state;
+
+	explicit SplitMix64(std::uint64_t seed = 0x9e3779b97f4a7c15) : state(seed)
+	{
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return UINT64_MAX; }
+
+	result_type operator()()
+	{
+		std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+		return z ^ (z >> 31);
+	}
+};
+
+class UniformSampler
+{
+	/*
+	 * Draws derivations of a given length uniformly at random (words, if the
+	 * grammar is unambiguous). The exact counts are turned into cumulative
+	 * probabilities once, so a draw is a handful of binary searches over flat
+	 * arrays and does no big number arithmetic.
+	 */
+	struct Choice
+	{
+		double cumulative;
+		Symbol left, right; // left is the terminal when split == 0
+		std::uint32_t split;
+	};
+
+	const CNFGrammar& grammar;
+	const size_t maxLength;
+
+	// choices for (length, A) are choices[offsets[length * N + A] ..
+	// offsets[length * N + A + 1])
+	std::vector<size_t> offsets{};
+	std::vector<Choice> choices{};
+
+	std::vector<std::pair<Symbol, size_t>> pending{};
+
+	size_t slot(size_t length, Symbol A) const
+	{
+		return length * grammar.nonterminalCount() + A;
+	}
+
+	template <typename RNG> static double uniform(RNG& rng)
+	{
+		return static_cast<double>(rng() >> 11) * 0x1.0p-53;
+	}
+
+public:
+	UniformSampler(LanguageCounter const& counter)
+	    : grammar(counter.cnf()), maxLength(counter.maxLength())
+	{
+		const size_t N = grammar.nonterminalCount();
+		offsets.reserve((maxLength + 1) * N + 1);
+
+		for (size_t length = 0; length <= maxLength; ++length) {
+			for (Symbol A = 0; A < N; ++A) {
+				offsets.push_back(choices.size());
+				if (length == 0) continue;
+
+				BigUnsigned total = counter.derivations(A, length), running;
+				if (total.isZero()) continue;
+
+				auto add = [&](BigUnsigned const& block, Choice choice) {
+					running += block;
+					choice.cumulative = BigUnsigned::ratio(running, total);
+					choices.push_back(choice);
+				};
+
+				if (length == 1)
+					for (size_t i : counter.terminalRulesFrom(A)) {
+						auto const& rule = grammar.terminalRules[i];
+						add(rule.multiplicity, {0, rule.terminal, 0, 0});
+					}
+
+				for (size_t i : counter.binaryRulesFrom(A)) {
+					auto const& rule = grammar.binaryRules[i];
+					for (size_t k = 1; k < length; ++k) {
+						BigUnsigned block =
+						    counter.derivations(rule.left, k) *
+						    counter.derivations(rule.right, length - k);
+						if (block.isZero()) continue;
+
+						add(block * rule.multiplicity,
+						    {0, rule.left, rule.right,
+						     static_cast<std::uint32_t>(k)});
+					}
+				}
+
+				choices.back().cumulative = 1.0;
+			}
+		}
+		offsets.push_back(choices.size());
+	}
+
+	UniformSampler(UniformSampler const&) = delete;
+
+	bool canSample(size_t length) const
+	{
+		if (length == 0) return grammar.acceptsEmpty();
+
+		size_t s = slot(length, grammar.start);
+		return length <= maxLength && offsets[s] != offsets[s + 1];
+	}
+
+	/*
+	 * Replaces `word` with a random word of the given length. Returns false
+	 * if the language has no such word.
+	 */
+	template <typename RNG>
+	bool sample(size_t length, RNG& rng, std::vector<Symbol>& word)
+	{
+		word.clear();
+		if (!canSample(length)) return false;
+
+		pending.clear();
+		if (length) pending.emplace_back(grammar.start, length);
+
+		while (!pending.empty()) {
+			auto [A, span] = pending.back();
+			pending.pop_back();
+
+			auto first = choices.begin() + static_cast<std::ptrdiff_t>(offsets[slot(span, A)]);
+			auto last = choices.begin() + static_cast<std::ptrdiff_t>(offsets[slot(span, A) + 1]);
+
+			double u = uniform(rng);
+			auto picked = std::upper_bound(
+			    first, last, u,
+			    [](double x, Choice const& c) { return x < c.cumulative; });
+			if (picked == last) --picked;
+
+			if (picked->split == 0) {
+				word.push_back(picked->left);
+			} else {
+				pending.emplace_back(picked->right, span - picked->split);
+				pending.emplace_back(picked->left, picked->split);
+			}
+		}
+
+		return true;
+	}
+};
+
+} // namespace context_free
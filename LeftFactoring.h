@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CFGrammar.h"
+
+namespace context_free {
+
+/*
+ * Candidates for nonterminals made up by grammar transformations: the
+ * `index`-th one, or nothing once a char type has run out of them. Callers
+ * skip the candidates that are taken already.
+ */
+inline std::optional<LetterChar> freshChar(LetterChar const&, size_t index)
+{
+	// Printable chars that the grammar format reads as symbols, so that a
+	// transformed grammar can be written out and read back.
+	static const std::string candidates =
+	    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghijklmnopqrstuvwxyz"
+	    "!$%&*+-./:;<=>?^_|~";
+	if (index >= candidates.size()) return std::nullopt;
+	return LetterChar{candidates[index]};
+}
+
+inline std::optional<TokenChar> freshChar(TokenChar const& owner, size_t index)
+{
+	return TokenChar{owner.name + "'" + std::to_string(index + 1)};
+}
+
+template <typename C> class LeftFactoring
+{
+	/*
+	 * Rewrites a grammar so that no two rules of a nonterminal start with the
+	 * same symbol. The rules of every nonterminal form a trie of their
+	 * right-hand sides; wherever several rules share a prefix, the prefix is
+	 * kept once and what follows it goes to a fresh nonterminal:
+	 *
+	 *   A -> x y B | x y C | z    becomes    A -> x y A' | z,  A' -> B | C
+	 *
+	 * Fresh nonterminals are hash-consed: two tails with the same rules get
+	 * the same nonterminal, whichever rules they came from. Identical rules
+	 * are merged, their weights added. That keeps the language and the
+	 * total weight of the derivations of every word, but not the number of
+	 * derivations: S -> a | a has two derivations of "a", the result one.
+	 *
+	 * If the char type runs out of fresh chars, the remaining prefixes are
+	 * left unfactored, which is still the same language.
+	 */
+	struct Alternative
+	{
+		std::vector<const C*> to;
+		double weight;
+	};
+
+	using Alternatives = std::vector<Alternative>;
+
+	CFGrammarTouple<C, C> const& source;
+
+	std::vector<const C*> order{}; // the nonterminals, source ones first
+	std::map<const C*, Alternatives> rulesOf{};
+	std::vector<std::unique_ptr<C>> freshOnes{};
+	size_t nextCandidate = 0;
+
+	// Tails by their rules, for the hash-consing.
+	std::map<std::vector<std::pair<std::vector<const C*>, double>>, const C*>
+	    byTail{};
+
+	bool taken(C const& c) const
+	{
+		if (source.alphabets->N->findChar(c) || source.alphabets->T->findChar(c))
+			return true;
+		for (auto const& fresh : freshOnes)
+			if (*fresh == c) return true;
+		return false;
+	}
+
+	const C* makeFresh(C const& owner)
+	{
+		while (auto candidate = freshChar(owner, nextCandidate)) {
+			++nextCandidate;
+			if (taken(*candidate)) continue;
+			freshOnes.push_back(std::make_unique<C>(*candidate));
+			return freshOnes.back().get();
+		}
+		return nullptr;
+	}
+
+	static Alternatives merged(Alternatives alternatives)
+	{
+		// By the chars rather than their addresses, so that fresh chars are
+		// handed out the same way on every run.
+		std::stable_sort(alternatives.begin(), alternatives.end(),
+		                 [](Alternative const& a, Alternative const& b) {
+			                 return std::lexicographical_compare(
+			                     a.to.begin(), a.to.end(), b.to.begin(),
+			                     b.to.end(),
+			                     [](const C* x, const C* y) { return *x < *y; });
+		                 });
+
+		Alternatives unique;
+		for (auto& alternative : alternatives) {
+			if (!unique.empty() && unique.back().to == alternative.to)
+				unique.back().weight += alternative.weight;
+			else
+				unique.push_back(std::move(alternative));
+		}
+		return unique;
+	}
+
+	// The nonterminal for a tail, or nullptr if no fresh char is left.
+	const C* tail(C const& owner, Alternatives alternatives)
+	{
+		std::vector<std::pair<std::vector<const C*>, double>> key;
+		for (auto const& alternative : alternatives)
+			key.emplace_back(alternative.to, alternative.weight);
+
+		if (auto found = byTail.find(key); found != byTail.end())
+			return found->second;
+
+		const C* fresh = makeFresh(owner);
+		if (!fresh) return nullptr;
+		byTail.emplace(std::move(key), fresh);
+		order.push_back(fresh);
+		rulesOf[fresh] = factor(owner, std::move(alternatives));
+		return fresh;
+	}
+
+	// The alternatives sorted and merged, with every shared prefix factored.
+	Alternatives factor(C const& owner, Alternatives alternatives)
+	{
+		alternatives = merged(std::move(alternatives));
+
+		Alternatives factored;
+		for (size_t begin = 0; begin < alternatives.size();) {
+			// Sorted, the alternatives with the same first symbol are adjacent.
+			auto const& first = alternatives[begin].to;
+			size_t end = begin + 1;
+			while (!first.empty() && end < alternatives.size() &&
+			       !alternatives[end].to.empty() &&
+			       alternatives[end].to.front() == first.front())
+				++end;
+
+			if (end - begin == 1) {
+				factored.push_back(std::move(alternatives[begin]));
+				begin = end;
+				continue;
+			}
+
+			// The longest common prefix is that of the first and the last.
+			auto const& last = alternatives[end - 1].to;
+			size_t prefix = 1;
+			while (prefix < first.size() && prefix < last.size() &&
+			       first[prefix] == last[prefix])
+				++prefix;
+
+			Alternatives tails;
+			for (size_t i = begin; i < end; ++i)
+				tails.push_back({std::vector<const C*>(
+				                     alternatives[i].to.begin() +
+				                         static_cast<std::ptrdiff_t>(prefix),
+				                     alternatives[i].to.end()),
+				                 alternatives[i].weight});
+
+			if (const C* rest = tail(owner, std::move(tails))) {
+				std::vector<const C*> to(first.begin(),
+				                         first.begin() +
+				                             static_cast<std::ptrdiff_t>(prefix));
+				to.push_back(rest);
+				factored.push_back({std::move(to), 1});
+			} else {
+				for (size_t i = begin; i < end; ++i)
+					factored.push_back(std::move(alternatives[i]));
+			}
+			begin = end;
+		}
+		return factored;
+	}
+
+public:
+	LeftFactoring(CFGrammarTouple<C, C> const& source) : source(source)
+	{
+		source.alphabets->N->for_each([this](C const& c) {
+			order.push_back(&c);
+			rulesOf[&c];
+		});
+
+		for (auto const& rule : source.rules) {
+			std::vector<const C*> to(rule.to.string.begin(), rule.to.string.end());
+			rulesOf[&rule.from].push_back({std::move(to), rule.weight});
+		}
+
+		// Fresh nonterminals are appended to `order` as they come up.
+		const size_t sourceNonterminals = order.size();
+		for (size_t i = 0; i < sourceNonterminals; ++i)
+			rulesOf[order[i]] = factor(*order[i], std::move(rulesOf[order[i]]));
+	}
+
+	LeftFactoring(LeftFactoring const&) = delete;
+
+	// The fresh nonterminals made up.
+	size_t freshCount() const { return freshOnes.size(); }
+
+	CFGrammarTouple<C, C> grammar() const
+	{
+		std::vector<std::unique_ptr<C>> nonterminals;
+		for (const C* c : order)
+			nonterminals.push_back(std::make_unique<C>(*c));
+		auto N = std::make_shared<Alphabet<C>>(std::move(nonterminals));
+		auto alphabets =
+		    std::make_shared<AlphabetToupleDistinct<C, C>>(N, source.alphabets->T);
+
+		std::vector<Rule<C, C>> rules;
+		for (const C* from : order)
+			for (auto const& alternative : rulesOf.at(from)) {
+				std::vector<const C*> to;
+				for (const C* c : alternative.to)
+					to.push_back(alphabets->findChar(*c));
+				rules.emplace_back(*N->findChar(*from),
+				                   AlphaString<C>::fromChars(alphabets, std::move(to)),
+				                   alternative.weight);
+			}
+
+		return {alphabets, *source.start, std::move(rules)};
+	}
+};
+
+template <typename C>
+CFGrammarTouple<C, C> leftFactor(CFGrammarTouple<C, C> const& grammar)
+{
+	return LeftFactoring<C>{grammar}.grammar();
+}
+
+} // namespace context_free
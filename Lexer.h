@@ -0,0 +1,467 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AlphaString.h"
+#include "CFParser.h"
+
+namespace context_free {
+
+/*
+ * A kind of token: the lexemes matching `pattern` are read as `terminal`, or
+ * skipped if there is none (for whitespace and comments).
+ *
+ * Patterns are regular expressions over bytes: literal chars, "." for any
+ * byte but a newline, classes like "[a-z_]" or "[^0-9]", the escapes \n, \t,
+ * \d, \w, \s and \ before any other char to take it literally, grouping with
+ * parentheses, "|", and the postfix operators "*", "+" and "?".
+ */
+template <typename C> struct TokenDefinition
+{
+	std::optional<C> terminal;
+	std::string pattern;
+};
+
+template <typename C> class Lexer
+{
+	/*
+	 * Splits a text into tokens by the longest match, ties going to the
+	 * definition that comes first. All patterns are compiled into one
+	 * deterministic automaton over classes of bytes that no pattern tells
+	 * apart, so a byte costs one table lookup whatever the number of
+	 * definitions.
+	 */
+public:
+	using Id = std::uint32_t;
+
+	struct Token
+	{
+		Id definition;
+		size_t begin, length;
+	};
+
+private:
+	static constexpr Id none = UINT32_MAX;
+	using ByteSet = std::bitset<256>;
+
+	const std::shared_ptr<AlphabetLike<C>> alphabet;
+	std::vector<const C*> terminals{}; // by definition, nullptr if skipped
+
+	std::array<std::uint8_t, 256> byteClass{};
+	size_t classes = 1;
+
+	// State 0 is dead, 1 the start.
+	std::vector<Id> next{};     // [state * classes + byte class]
+	std::vector<Id> accepting{}; // the definition, or none
+
+	/*
+	 * Thompson's construction: every state either moves on a set of bytes to
+	 * `next` or has epsilon moves.
+	 */
+	struct Nfa
+	{
+		struct State
+		{
+			ByteSet on{};
+			Id next = none;
+			std::vector<Id> epsilon{};
+		};
+
+		struct Fragment
+		{
+			Id start, end;
+		};
+
+		std::vector<State> states{};
+		std::vector<ByteSet> sets{};
+
+		Id add()
+		{
+			states.emplace_back();
+			return static_cast<Id>(states.size() - 1);
+		}
+
+		Fragment bytes(ByteSet const& on)
+		{
+			Fragment fragment{add(), add()};
+			states[fragment.start].on = on;
+			states[fragment.start].next = fragment.end;
+			sets.push_back(on);
+			return fragment;
+		}
+
+		Fragment empty()
+		{
+			Fragment fragment{add(), add()};
+			states[fragment.start].epsilon.push_back(fragment.end);
+			return fragment;
+		}
+	};
+
+	class PatternParser
+	{
+		Nfa& nfa;
+		std::string_view pattern;
+		size_t at = 0;
+
+		[[noreturn]] void fail(const char* what) const
+		{
+			std::ostringstream error;
+			error << "Bad token pattern \"" << pattern << "\" at " << at << ": "
+			      << what << ".";
+			throw std::invalid_argument(error.str());
+		}
+
+		bool done() const { return at == pattern.size(); }
+		char peek() const { return pattern[at]; }
+
+		static ByteSet range(unsigned char from, unsigned char to)
+		{
+			ByteSet set;
+			for (unsigned c = from; c <= to; ++c)
+				set.set(c);
+			return set;
+		}
+
+		// The set of an escape whose backslash was just read.
+		ByteSet escaped()
+		{
+			if (done()) fail("a trailing backslash");
+			const char c = pattern[at++];
+			switch (c) {
+			case 'n': return range('\n', '\n');
+			case 't': return range('\t', '\t');
+			case 'd': return range('0', '9');
+			case 'w':
+				return range('a', 'z') | range('A', 'Z') | range('0', '9') |
+				       range('_', '_');
+			case 's':
+				return range(' ', ' ') | range('\t', '\r');
+			default:
+				return range(static_cast<unsigned char>(c),
+				             static_cast<unsigned char>(c));
+			}
+		}
+
+		ByteSet bracket()
+		{
+			const bool negated = !done() && peek() == '^';
+			if (negated) ++at;
+
+			ByteSet set;
+			bool first = true;
+			while (true) {
+				if (done()) fail("an unclosed [");
+				if (peek() == ']' && !first) break;
+				first = false;
+
+				if (peek() == '\\') {
+					++at;
+					set |= escaped();
+					continue;
+				}
+
+				const auto from = static_cast<unsigned char>(pattern[at++]);
+				if (at + 1 < pattern.size() && peek() == '-' &&
+				    pattern[at + 1] != ']') {
+					const auto to = static_cast<unsigned char>(pattern[at + 1]);
+					if (to < from) fail("a reversed range");
+					set |= range(from, to);
+					at += 2;
+				} else {
+					set.set(from);
+				}
+			}
+			++at;
+
+			return negated ? ~set : set;
+		}
+
+		typename Nfa::Fragment atom()
+		{
+			const char c = pattern[at++];
+			switch (c) {
+			case '(': {
+				auto inner = alternation();
+				if (done() || peek() != ')') fail("an unclosed (");
+				++at;
+				return inner;
+			}
+			case '[': return nfa.bytes(bracket());
+			case '.': return nfa.bytes(~range('\n', '\n'));
+			case '\\': return nfa.bytes(escaped());
+			case '*':
+			case '+':
+			case '?': fail("an operator with nothing before it");
+			case ')': fail("an unopened )");
+			default:
+				return nfa.bytes(range(static_cast<unsigned char>(c),
+				                       static_cast<unsigned char>(c)));
+			}
+		}
+
+		typename Nfa::Fragment repetition()
+		{
+			auto fragment = atom();
+			while (!done() && (peek() == '*' || peek() == '+' || peek() == '?')) {
+				const char op = pattern[at++];
+				typename Nfa::Fragment around{nfa.add(), nfa.add()};
+				auto& start = nfa.states[around.start].epsilon;
+				start.push_back(fragment.start);
+				if (op != '+') start.push_back(around.end);
+
+				auto& end = nfa.states[fragment.end].epsilon;
+				end.push_back(around.end);
+				if (op != '?') end.push_back(fragment.start);
+
+				fragment = around;
+			}
+			return fragment;
+		}
+
+		typename Nfa::Fragment sequence()
+		{
+			if (done() || peek() == '|' || peek() == ')') return nfa.empty();
+
+			auto fragment = repetition();
+			while (!done() && peek() != '|' && peek() != ')') {
+				auto following = repetition();
+				nfa.states[fragment.end].epsilon.push_back(following.start);
+				fragment.end = following.end;
+			}
+			return fragment;
+		}
+
+		typename Nfa::Fragment alternation()
+		{
+			auto fragment = sequence();
+			while (!done() && peek() == '|') {
+				++at;
+				auto other = sequence();
+				typename Nfa::Fragment either{nfa.add(), nfa.add()};
+				nfa.states[either.start].epsilon = {fragment.start, other.start};
+				nfa.states[fragment.end].epsilon.push_back(either.end);
+				nfa.states[other.end].epsilon.push_back(either.end);
+				fragment = either;
+			}
+			return fragment;
+		}
+
+	public:
+		PatternParser(Nfa& nfa, std::string_view pattern)
+		    : nfa(nfa), pattern(pattern)
+		{
+		}
+
+		typename Nfa::Fragment parse()
+		{
+			auto fragment = alternation();
+			if (!done()) fail("an unopened )");
+			return fragment;
+		}
+	};
+
+	// Bytes that no set of the automaton tells apart share a class.
+	void classifyBytes(std::vector<ByteSet> const& sets)
+	{
+		byteClass.fill(0);
+		classes = 1;
+		for (auto const& set : sets) {
+			std::map<std::pair<std::uint8_t, bool>, std::uint8_t> split;
+			for (unsigned c = 0; c < 256; ++c) {
+				auto key = std::make_pair(byteClass[c], bool(set[c]));
+				auto found = split.emplace(key, static_cast<std::uint8_t>(split.size()));
+				byteClass[c] = found.first->second;
+			}
+			classes = split.size();
+		}
+	}
+
+	static void close(Nfa const& nfa, std::vector<Id>& states)
+	{
+		std::vector<bool> in(nfa.states.size());
+		for (Id state : states)
+			in[state] = true;
+		for (size_t i = 0; i < states.size(); ++i)
+			for (Id to : nfa.states[states[i]].epsilon)
+				if (!in[to]) {
+					in[to] = true;
+					states.push_back(to);
+				}
+		std::sort(states.begin(), states.end());
+	}
+
+public:
+	Lexer(std::shared_ptr<AlphabetLike<C>> alphabet,
+	      std::vector<TokenDefinition<C>> const& definitions)
+	    : alphabet(std::move(alphabet))
+	{
+		if (definitions.empty())
+			throw std::invalid_argument("A lexer needs some token definitions.");
+
+		Nfa nfa;
+		const Id start = nfa.add();
+		std::vector<Id> finalOf(definitions.size());
+
+		for (size_t d = 0; d < definitions.size(); ++d) {
+			auto const& definition = definitions[d];
+			const C* terminal = nullptr;
+			if (definition.terminal) {
+				terminal = this->alphabet->findChar(*definition.terminal);
+				if (!terminal)
+					throw std::invalid_argument(
+					    "A token definition names a terminal not in alphabet.");
+			}
+			terminals.push_back(terminal);
+
+			auto fragment = PatternParser{nfa, definition.pattern}.parse();
+			nfa.states[start].epsilon.push_back(fragment.start);
+			finalOf[d] = fragment.end;
+		}
+
+		std::vector<Id> definitionOf(nfa.states.size(), none);
+		for (size_t d = definitions.size(); d-- > 0;)
+			definitionOf[finalOf[d]] = static_cast<Id>(d);
+
+		classifyBytes(nfa.sets);
+		std::vector<unsigned char> representative(classes);
+		for (unsigned c = 256; c-- > 0;)
+			representative[byteClass[c]] = static_cast<unsigned char>(c);
+
+		// The subset construction, with state 0 for the empty subset.
+		std::map<std::vector<Id>, Id> ids{{{}, 0}};
+		std::vector<std::vector<Id>> subsets{{}};
+		auto idOf = [&](std::vector<Id>&& subset) {
+			auto found = ids.emplace(subset, static_cast<Id>(subsets.size()));
+			if (found.second) subsets.push_back(std::move(subset));
+			return found.first->second;
+		};
+
+		std::vector<Id> initial{start};
+		close(nfa, initial);
+		idOf(std::move(initial));
+
+		for (size_t s = 0; s < subsets.size(); ++s) {
+			Id accepts = none;
+			for (Id state : subsets[s])
+				accepts = std::min(accepts, definitionOf[state]);
+			accepting.push_back(accepts);
+
+			for (size_t k = 0; k < classes; ++k) {
+				std::vector<Id> target;
+				for (Id state : subsets[s])
+					if (nfa.states[state].on[representative[k]])
+						target.push_back(nfa.states[state].next);
+				close(nfa, target);
+				target.erase(std::unique(target.begin(), target.end()),
+				             target.end());
+				next.push_back(idOf(std::move(target)));
+			}
+		}
+
+		if (accepting[1] != none) {
+			std::ostringstream error;
+			error << "The token pattern \"" << definitions[accepting[1]].pattern
+			      << "\" matches the empty string.";
+			throw std::invalid_argument(error.str());
+		}
+	}
+
+	// The states of the automaton, the dead one included.
+	size_t states() const { return accepting.size(); }
+
+	size_t byteClasses() const { return classes; }
+
+	/*
+	 * The tokens of the text, skipped ones left out. Throws
+	 * std::invalid_argument where no token matches.
+	 */
+	std::vector<Token> tokens(std::string_view text) const
+	{
+		std::vector<Token> found;
+
+		for (size_t begin = 0; begin < text.size();) {
+			Id state = 1, matched = none;
+			size_t length = 0;
+			for (size_t at = begin; at < text.size(); ++at) {
+				state = next[state * classes +
+				             byteClass[static_cast<unsigned char>(text[at])]];
+				if (!state) break;
+				if (accepting[state] != none) {
+					matched = accepting[state];
+					length = at + 1 - begin;
+				}
+			}
+
+			if (matched == none) {
+				std::ostringstream error;
+				error << "No token matches the text at offset " << begin << ".";
+				throw std::invalid_argument(error.str());
+			}
+
+			if (terminals[matched]) found.push_back({matched, begin, length});
+			begin += length;
+		}
+
+		return found;
+	}
+
+	// The text as a word over the terminals of the tokens.
+	AlphaString<C> lex(std::string_view text) const
+	{
+		std::vector<const C*> word;
+		for (auto const& token : tokens(text))
+			word.push_back(terminals[token.definition]);
+
+		return AlphaString<C>::fromChars(alphabet, std::move(word));
+	}
+
+	const C* terminalOf(Token const& token) const
+	{
+		return terminals[token.definition];
+	}
+};
+
+/*
+ * Token definitions, one per line: the terminal the token is read as, or "@"
+ * to skip it, and after whitespace the pattern, which runs to the end of the
+ * line.
+ */
+template <typename C>
+std::vector<TokenDefinition<C>> parseTokenDefinitions(istream& input,
+                                                      AlphabetLike<C> const& alphabet)
+{
+	std::vector<TokenDefinition<C>> definitions;
+
+	while (!streamFinished(input)) {
+		std::optional<C> terminal;
+		if (input.peek() == '@')
+			input.get();
+		else
+			terminal.emplace(parseLetterChar(input, alphabet));
+
+		std::string pattern;
+		input >> std::ws;
+		std::getline(input, pattern);
+		if (pattern.empty())
+			throw std::runtime_error("Couldn't read a token pattern from the input");
+
+		definitions.push_back({std::move(terminal), std::move(pattern)});
+	}
+
+	return definitions;
+}
+
+} // namespace context_free
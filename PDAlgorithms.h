@@ -2,6 +2,7 @@
 
 #include "Automata.h"
 #include "CFGrammar.h"
+#include "Tracing.h"
 
 namespace context_free {
 
@@ -21,6 +22,8 @@ struct StackBottomChar : Char
 	friend bool operator==(StackBottomChar, StackBottomChar) { return true; }
 };
 
+inline size_t hashChar(StackBottomChar const&) { return 0; }
+
 template <typename C>
 inline static auto
 extendAlphabet(const std::shared_ptr<AlphabetLike<C>> alphabet)
@@ -37,6 +40,8 @@ extendAlphabet(const std::shared_ptr<AlphabetLike<C>> alphabet)
 template <typename CN, typename CT>
 auto grammarToAutomata(CFGrammarTouple<CT, CN> const& grammar)
 {
+	TraceSpan span{"grammarToAutomata"};
+
 	AlphabetToupleDistinct stackAlphabet = extendAlphabet<typename decltype(
 	    grammar.alphabets)::element_type::char_type>(grammar.alphabets);
 
@@ -45,7 +50,6 @@ auto grammarToAutomata(CFGrammarTouple<CT, CN> const& grammar)
 	using MeatBall = MeatBall<CStack, CT, CStackPtrBox>;
 
 	auto bottomPtr = stackAlphabet.T->findChar(StackBottomChar{'#'});
-	auto bottom = StackBottomChar{'#'};
 
 	std::forward_list<MeatBall> meatBalls;
 	meatBalls.emplace_front("start");
@@ -61,11 +65,16 @@ auto grammarToAutomata(CFGrammarTouple<CT, CN> const& grammar)
 	    CStack{bottomPtr}, std::nullopt,
 	    std::make_shared<Push<CStack, CStack>>(CStack{grammar.start}), wild);
 
+	// A rule replaces its nonterminal on top with the whole right-hand
+	// side; an epsilon rule just pops it.
 	for (auto const& rule : grammar.rules) {
+		std::vector<CStack> rhs;
+		for (auto const* c : rule.to.string)
+			rhs.push_back(CStack{c});
+
 		wild.addTransition(CStack{stackAlphabet.findChar(rule.from)},
 		                   std::nullopt,
-		                   std::make_shared<Replace<CStack, CStackPtrBox>>(
-		                       CStack{rule.to.string[0]}),
+		                   std::make_shared<Expand<CStack, CStackPtrBox>>(rhs),
 		                   wild);
 	}
 
@@ -79,7 +88,7 @@ auto grammarToAutomata(CFGrammarTouple<CT, CN> const& grammar)
 
 	return Automata<CStack, CT, CStackPtrBox>{
 	    std::make_shared<decltype(stackAlphabet)>(std::move(stackAlphabet)),
-	    grammar.alphabets->T, std::move(meatBalls), start};
+	    grammar.alphabets->T, std::move(meatBalls), start, CStack{bottomPtr}};
 }
 
 template <typename A1, typename A2> auto automataUnion(A1 const&, A2 const&) {}
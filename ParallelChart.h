@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class Barrier
+{
+	std::mutex lock{};
+	std::condition_variable released{};
+	const size_t parties;
+	size_t waiting = 0;
+	size_t generation = 0;
+
+public:
+	explicit Barrier(size_t parties) : parties(parties) {}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> guard{lock};
+		size_t arrivedIn = generation;
+
+		if (++waiting == parties) {
+			waiting = 0;
+			++generation;
+			released.notify_all();
+			return;
+		}
+
+		released.wait(guard, [&] { return generation != arrivedIn; });
+	}
+};
+
+class TileQueues
+{
+	/*
+	 * Every worker owns a range of tiles and takes them from the front. A
+	 * worker that runs dry steals from the back of someone else's range.
+	 * Tiles are coarse, so a mutex per range costs nothing noticeable.
+	 */
+	struct Range
+	{
+		std::mutex lock{};
+		size_t begin = 0, end = 0;
+	};
+
+	std::vector<std::unique_ptr<Range>> ranges{};
+
+public:
+	explicit TileQueues(size_t workers)
+	{
+		for (size_t i = 0; i < workers; ++i)
+			ranges.push_back(std::make_unique<Range>());
+	}
+
+	void assign(size_t worker, size_t begin, size_t end)
+	{
+		std::lock_guard<std::mutex> guard{ranges[worker]->lock};
+		ranges[worker]->begin = begin;
+		ranges[worker]->end = end;
+	}
+
+	bool take(size_t worker, size_t& tile)
+	{
+		Range& own = *ranges[worker];
+		{
+			std::lock_guard<std::mutex> guard{own.lock};
+			if (own.begin < own.end) {
+				tile = own.begin++;
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < ranges.size(); ++i) {
+			Range& victim = *ranges[(worker + i) % ranges.size()];
+			std::lock_guard<std::mutex> guard{victim.lock};
+			if (victim.begin < victim.end) {
+				tile = --victim.end;
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+/*
+ * Fills a CYK chart whose length-1 spans are already set, one length (one
+ * anti-diagonal) at a time. The spans of one length only read shorter spans,
+ * so each diagonal is cut into tiles that the workers share out, with a
+ * barrier between diagonals.
+ *
+ * Works with any engine that has fillSpan(chart, begin, length) safe to call
+ * concurrently for spans of the same length: ChartParser and
+ * ChartRecognizer both qualify.
+ */
+template <typename Engine, typename ChartT>
+void fillChartParallel(Engine const& engine, ChartT& chart,
+                       size_t threads = std::thread::hardware_concurrency())
+{
+	const size_t n = chart.size();
+	threads = std::max<size_t>(1, std::min(threads, n / 2));
+
+	if (threads == 1) {
+		for (size_t length = 2; length <= n; ++length)
+			for (size_t begin = 0; begin + length <= n; ++begin)
+				engine.fillSpan(chart, begin, length);
+		return;
+	}
+
+	TileQueues queue{threads};
+	Barrier barrier{threads};
+
+	auto work = [&](size_t worker) {
+		for (size_t length = 2; length <= n; ++length) {
+			const size_t spans = n - length + 1;
+			const size_t tiles = std::min(spans, threads * 4);
+			const size_t tileSize = (spans + tiles - 1) / tiles;
+
+			// A thief that looks before the owner got here just finds an
+			// empty range and leaves the tiles to their owner.
+			queue.assign(worker, tiles * worker / threads,
+			             tiles * (worker + 1) / threads);
+
+			for (size_t tile; queue.take(worker, tile);) {
+				size_t first = tile * tileSize;
+				size_t last = std::min(spans, first + tileSize);
+				for (size_t begin = first; begin < last; ++begin)
+					engine.fillSpan(chart, begin, length);
+			}
+
+			barrier.wait();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t worker = 1; worker < threads; ++worker)
+		workers.emplace_back(work, worker);
+	work(0);
+
+	for (auto& thread : workers)
+		thread.join();
+}
+
+template <typename Engine>
+auto parseParallel(Engine const& engine, std::vector<Symbol> word,
+                   size_t threads = std::thread::hardware_concurrency())
+{
+	auto chart = engine.makeChart(std::move(word));
+	engine.fillTerminals(chart);
+	fillChartParallel(engine, chart, threads);
+	return chart;
+}
+
+} // namespace context_free
@@ -1,67 +1,442 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
 #include "AlphaString.h"
-#include "MeatBall.h"
-#include "Stack.h"
-#include <list>
+#include "CompiledAutomaton.h"
+#include "Frontier.h"
+#include "Tracing.h"
 
 namespace context_free {
 
-template <typename CStack, typename CTerminal, typename CStackPtrBox> class ReadState
+enum class SearchMode
+{
+	Frontier,          // the strategy's frontier, as long as it fits
+	IterativeDeepening // depth-first under a growing stack height limit
+};
+
+inline const char* toString(SearchMode mode)
+{
+	switch (mode) {
+	case SearchMode::Frontier: return "frontier";
+	case SearchMode::IterativeDeepening: return "iterative deepening";
+	default: return "unknown";
+	}
+}
+
+template <typename CStack, typename CTerminal, typename CStackPtrBox,
+          typename Strategy = BreadthFirst>
+class ReadState
 {
+	/*
+	 * Searches the runs of an automaton on a word. Heads wait in the
+	 * frontier of the Strategy until they are expanded. Expanding a head
+	 * takes the epsilon closure of its configuration from the compiled
+	 * automaton and then reads the next char, so every head in the frontier
+	 * has just read one.
+	 *
+	 * Memory is measured in cells: a head costs one cell plus one per char
+	 * on its stack. Every head the reader holds counts, those of a closure
+	 * being taken included. Once the frontier takes more than `memoryLimit`
+	 * cells, it is dropped and the search starts over as an
+	 * iterative-deepening depth-first search, which only keeps the current
+	 * run and the choices left at each char of it. It cuts off runs whose
+	 * stack grows beyond a limit and doubles the limit whenever something
+	 * was cut off, so it still decides every word, only more slowly. Should
+	 * a single closure or the run itself outgrow the memory while deepening,
+	 * the head is dropped; like a strategy that drops heads, the reader then
+	 * never finishes without accepting.
+	 *
+	 * A closure can take exponentially many moves, so a call to advance()
+	 * stops once closures have made `closureWork` cells of heads; a closure
+	 * left unfinished goes on at the next call.
+	 */
 	using Word = AlphaString<CTerminal>;
-	using WordPtr = typename Word::const_iterator;
-	using MeatBallT = const MeatBall<CStack, CTerminal, CStackPtrBox>;
+	using Compiled = CompiledAutomaton<CStack, CTerminal, CStackPtrBox>;
+	using Id = typename Compiled::Id;
+
+public:
+	struct StateHead
+	{
+		Id state;
+		std::vector<Id> stack; // the top last
+		size_t consumed;
+
+		bool operator==(StateHead const& other) const
+		{
+			return state == other.state && consumed == other.consumed &&
+			       stack == other.stack;
+		}
+	};
 
-	using StateHead = std::tuple<MeatBallT*, Stack<CStack, CStackPtrBox>, WordPtr>;
+	// Heads a call to advance() expands while deepening.
+	static constexpr size_t deepeningSteps = 256;
 
-	std::list<StateHead> heads{};
+	// Cells of heads a call to advance() makes in closures, give or take
+	// the outcomes of one configuration.
+	static constexpr size_t closureWork = 1 << 14;
+
+	const Word word;
+
+private:
+	const std::shared_ptr<const Compiled> automaton;
+	std::vector<Id> input{}; // the input ids of the word
+
+	typename Strategy::template Frontier<StateHead> frontier;
+
+	const size_t memoryLimit;
+	size_t frontierCells = 0;
+
+	struct HeadHash
+	{
+		size_t operator()(StateHead const& head) const
+		{
+			return static_cast<size_t>(hash(head));
+		}
+	};
+	using HeadSet = std::unordered_set<StateHead, HeadHash>;
+
+	// Every head pushed so far: a configuration reached twice at the same
+	// char need not be searched twice. Each takes its cells again here.
+	HeadSet pushed{};
+	SearchMode searchMode = SearchMode::Frontier;
+
+	struct Level
+	{
+		std::vector<StateHead> choices; // the heads after the next char
+		size_t next;
+	};
 
-	using HeadsIt = typename decltype(heads)::iterator;
+	const StateHead root;
+	std::vector<Level> path{};
+	size_t pathCells = 0; // of the choices left on the path
+	// Heads already searched under the current stack limit, each at the
+	// slot of its hash, where newer heads replace older ones. The table
+	// and the heads in it take at most half the memory limit; a head that
+	// does not fit is not remembered, and at worst searched again.
+	std::vector<std::optional<StateHead>> searched{};
+	size_t searchedCells = 0;
+	size_t stackLimit = 1;
+	bool cutOff = false, exhausted = false;
+	// Whether heads were dropped for memory in this pass, or in a pass that
+	// no larger stack limit can help; and how many so far.
+	bool starving = false, starved = false;
+	size_t starvedHeads = 0;
 
-	bool advance(StateHead const& head)
+	/*
+	 * A head whose closure is being taken: the configurations still to take
+	 * it of, those seen so far (closed, open), and while deepening the heads
+	 * after the next char. `cells` counts all of them.
+	 */
+	struct Expansion
 	{
-		auto& [meatBall, stack, nextChar] = head;
+		std::vector<StateHead> open{};
+		HeadSet seen[2]{};
+		std::vector<StateHead> choices{};
+		size_t heightBefore = 0, cells = 0;
+	};
+	std::optional<Expansion> expansion{};
 
-		if (nextChar == word.string.end()) { // No more chars to read.
-			// Hope we found it
-			return stack.empty();
+	// The track of this reader's counters in a trace. A frontier size is
+	// only recorded once it has halved or doubled since the last one, and
+	// at most maxTracedSizes times, so that long runs stay cheap to trace.
+	static constexpr size_t maxTracedSizes = 1024;
+	const std::uint64_t traceSeries =
+	    Tracer::instance().enabled() ? Tracer::instance().series() : 0;
+	size_t tracedSizes = 0, tracedFrontier = 0;
+
+	static size_t cells(StateHead const& head) { return 1 + head.stack.size(); }
+
+	static std::uint64_t hash(StateHead const& head)
+	{
+		std::uint64_t hash = (head.state + 1) * 0x9e3779b97f4a7c15 ^ head.consumed;
+		for (Id symbol : head.stack)
+			hash = (hash ^ symbol) * 0x100000001b3;
+		return hash ^ (hash >> 29);
+	}
+
+	void push(StateHead&& head)
+	{
+		if (!pushed.insert(head).second) return;
+		frontierCells += cells(head);
+
+		const size_t consumed = head.consumed, stackSize = head.stack.size();
+		if (frontier.push(std::move(head), consumed, stackSize))
+			frontierCells += 1 + stackSize;
+	}
+
+	/*
+	 * Whether the rest of the word can still empty the stack, going by the
+	 * yields of the chars on it. Stacks that grow by more than the rest of
+	 * the word plus the number of states and stack chars within a single
+	 * closure are given up as well: that only happens in loops over chars
+	 * that yield nothing.
+	 */
+	bool viable(std::vector<Id> const& stack, size_t consumed,
+	            size_t heightBefore) const
+	{
+		const size_t rest = word.string.size() - consumed;
+		if (stack.size() > heightBefore + rest + automaton->states() +
+		                       automaton->symbols())
+			return false;
+
+		size_t needed = 0;
+		for (Id symbol : stack) {
+			needed += std::min(automaton->yield(symbol), rest + 1);
+			if (needed > rest) return false;
 		}
+		return true;
+	}
+
+	Id topOf(std::vector<Id> const& stack) const
+	{
+		return stack.empty() ? automaton->empty() : stack.back();
+	}
+
+	void startExpansion(StateHead&& head)
+	{
+		const size_t height = head.stack.size(), taken = cells(head);
+		expansion.emplace();
+		expansion->open.push_back(std::move(head));
+		expansion->heightBefore = height;
+		expansion->cells = taken;
+	}
+
+	/*
+	 * Takes the closure of the expansion by epsilon moves further, until
+	 * the cells of the heads it makes use up `work` or the memory runs out.
+	 * Of every configuration reached, returns it if it is accepting, or
+	 * calls `next` with every head after reading one more char.
+	 */
+	template <typename Next>
+	std::optional<StateHead> expand(size_t& work, Next const& next)
+	{
+		Expansion& taking = *expansion;
+
+		while (!taking.open.empty() && work && memoryUsed() <= memoryLimit) {
+			StateHead from = std::move(taking.open.back());
+			taking.open.pop_back();
+			taking.cells -= cells(from);
+
+			size_t made = 1;
+			for (auto const& [action, isOpen] :
+			     automaton->closure(from.state, topOf(from.stack))) {
+				StateHead to{action.target, from.stack, from.consumed};
+				made += cells(to);
+				if (!automaton->apply(action, to.stack)) continue;
+				if (!viable(to.stack, to.consumed, taking.heightBefore)) continue;
+				if (!taking.seen[isOpen].insert(to).second) continue;
+				taking.cells += cells(to);
 
-		auto const& transitions = meatBall->next(stack, **nextChar);
+				if (isOpen) {
+					taking.cells += cells(to);
+					taking.open.push_back(std::move(to));
+					continue;
+				}
 
-		for (auto const& [cmd, targetMeatBall] : transitions) {
-			auto newStack{stack};
-			cmd->execute(newStack);
+				if (to.consumed == input.size()) {
+					if (to.stack.empty()) return to;
+					continue;
+				}
 
-			heads.push_front(
-			    std::make_tuple(targetMeatBall, newStack, nextChar + 1));
+				for (auto const& read :
+				     automaton->reads(to.state, topOf(to.stack), input[to.consumed])) {
+					StateHead after{read.target, to.stack, to.consumed + 1};
+					made += cells(after);
+					if (automaton->apply(read, after.stack)) next(std::move(after));
+				}
+			}
+			work -= std::min(work, made);
+		}
+
+		return std::nullopt;
+	}
+
+	void traceFrontier()
+	{
+		if (!traceSeries || tracedSizes == maxTracedSizes) return;
+
+		const size_t size = frontier.size();
+		if (tracedSizes &&
+		    (size == tracedFrontier ||
+		     (size < tracedFrontier * 2 && size * 2 > tracedFrontier)))
+			return;
+
+		++tracedSizes;
+		tracedFrontier = size;
+		traceCounter("frontier", traceSeries, static_cast<std::int64_t>(size));
+	}
+
+	void startDeepening()
+	{
+		frontier.clear();
+		pushed = {};
+		frontierCells = 0;
+		expansion.reset();
+		searched.assign(std::max<size_t>(1, memoryLimit / 8), std::nullopt);
+		searchedCells = 0;
+		searchMode = SearchMode::IterativeDeepening;
+		path.push_back({{root}, 0});
+		pathCells = cells(root);
+	}
+
+	/*
+	 * One step of the depth-first search: expands the next choice at the
+	 * deepest char, or backs up if there is none left. A choice whose
+	 * closure takes more than `work` goes on at the next step.
+	 */
+	std::optional<StateHead> deepen(size_t& work)
+	{
+		if (!expansion) {
+			if (path.empty()) {
+				if (!cutOff) {
+					// Another pass would drop the same heads again.
+					(starving ? starved : exhausted) = true;
+					return std::nullopt;
+				}
+
+				// Some runs were cut off: try again with room for them.
+				cutOff = starving = false;
+				stackLimit *= 2;
+				std::fill(searched.begin(), searched.end(), std::nullopt);
+				searchedCells = 0;
+				path.push_back({{root}, 0});
+				pathCells = cells(root);
+			}
+
+			Level& level = path.back();
+			if (level.next == level.choices.size()) {
+				path.pop_back();
+				return std::nullopt;
+			}
+
+			StateHead head = std::move(level.choices[level.next++]);
+			pathCells -= cells(head);
+			startExpansion(std::move(head));
+		}
+
+		auto accepted = expand(work, [&](StateHead&& to) {
+			if (to.stack.size() > stackLimit) {
+				cutOff = true;
+				return;
+			}
+
+			auto& slot = searched[hash(to) % searched.size()];
+			if (slot && *slot == to) return;
+			if (slot) {
+				searchedCells -= cells(*slot);
+				slot.reset();
+			}
+			if (searched.size() + searchedCells + cells(to) <= memoryLimit / 2) {
+				slot = to;
+				searchedCells += cells(to);
+			}
+			expansion->cells += cells(to);
+			expansion->choices.push_back(std::move(to));
+		});
+		if (accepted) return accepted;
+
+		if (memoryUsed() > memoryLimit) {
+			++starvedHeads;
+			starving = true;
+			expansion.reset();
+			return std::nullopt;
 		}
+		if (!expansion->open.empty()) return std::nullopt;
 
-		return false;
+		if (!expansion->choices.empty()) {
+			for (auto const& choice : expansion->choices)
+				pathCells += cells(choice);
+			path.push_back({std::move(expansion->choices), 0});
+		}
+		expansion.reset();
+		return std::nullopt;
 	}
 
 public:
-	const Word word;
+	ReadState(std::shared_ptr<const Compiled> automaton, Word const& word,
+	          std::vector<Id> initialStack, Strategy strategy = {},
+	          size_t memoryLimit = SIZE_MAX)
+	    : word(word), automaton(std::move(automaton)), frontier(strategy),
+	      memoryLimit(memoryLimit),
+	      root{this->automaton->start(), std::move(initialStack), 0}
+	{
+		input.reserve(this->word.string.size());
+		for (const CTerminal* c : this->word.string)
+			input.push_back(
+			    this->automaton->input(c).value_or(
+			        static_cast<Id>(this->automaton->terminals())));
+
+		push(StateHead(root));
+	}
 
-	ReadState(Word const& word, MeatBallT const& meatBall,
-	          Stack<CStack, CStackPtrBox> const& stack)
-	    : word(word)
+	/*
+	 * True once the word will never be accepted: every head has died out and
+	 * the strategy dropped none of them along the way.
+	 */
+	bool finished() const
 	{
-		StateHead init(&meatBall, stack, word.string.begin());
-		heads.push_back(init);
+		if (searchMode == SearchMode::IterativeDeepening) return exhausted;
+		return frontier.empty() && !frontier.dropped() && !expansion;
 	}
 
+	// How the search runs now; once finished, the mode that decided.
+	SearchMode mode() const { return searchMode; }
+
+	size_t frontierSize() const { return frontier.size(); }
+
+	// The cells the search takes; see the class comment.
+	size_t memoryUsed() const
+	{
+		return frontierCells + searched.size() + searchedCells + pathCells +
+		       (expansion ? expansion->cells : 0);
+	}
+
+	// Heads thrown away to stay within the memory bound, by the strategy or
+	// while deepening.
+	size_t droppedHeads() const { return frontier.dropped() + starvedHeads; }
+
+	/*
+	 * Expands as many heads as the frontier held when called, in the order
+	 * the strategy picks (for BreadthFirst: one more char for every head),
+	 * or `deepeningSteps` heads once deepening; fewer if their closures take
+	 * more than `closureWork`. Returns an accepting configuration as soon as
+	 * one turns up.
+	 */
 	std::optional<StateHead> advance()
 	{
-		for (HeadsIt it = heads.begin(); it != heads.end(); ) {
-			if (advance(*it)) {
-				return *it;
+		traceFrontier();
+		size_t work = closureWork;
+
+		if (searchMode == SearchMode::IterativeDeepening) {
+			for (size_t step = 0;
+			     step < deepeningSteps && work && !exhausted && !starved; ++step)
+				if (auto head = deepen(work)) return head;
+			return std::nullopt;
+		}
+
+		for (size_t n = frontier.size() + (expansion ? 1 : 0); n && work; --n) {
+			if (!expansion) {
+				if (frontier.empty()) break;
+				StateHead head = frontier.pop();
+				frontierCells -= cells(head);
+				startExpansion(std::move(head));
 			}
 
-			auto old = it;
-			++it;
-			heads.erase(old);
+			auto accepted =
+			    expand(work, [this](StateHead&& to) { push(std::move(to)); });
+			if (accepted) return accepted;
+
+			if (memoryUsed() > memoryLimit) {
+				startDeepening();
+				break;
+			}
+			if (expansion->open.empty()) expansion.reset();
 		}
 
 		return std::nullopt;
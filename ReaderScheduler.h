@@ -0,0 +1,275 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Tracing.h"
+
+namespace context_free {
+
+enum class ReadOutcome
+{
+	Pending,
+	Accepted,
+	Rejected,  // the reader ran out of heads
+	Exhausted, // the step limit was used up first
+	Expired,   // the deadline passed first
+	Cancelled
+};
+
+inline const char* toString(ReadOutcome outcome)
+{
+	switch (outcome) {
+	case ReadOutcome::Pending: return "pending";
+	case ReadOutcome::Accepted: return "accepted";
+	case ReadOutcome::Rejected: return "rejected";
+	case ReadOutcome::Exhausted: return "exhausted";
+	case ReadOutcome::Expired: return "expired";
+	case ReadOutcome::Cancelled: return "cancelled";
+	default: return "unknown";
+	}
+}
+
+template <typename Reader> class ReaderScheduler
+{
+	/*
+	 * Runs many readers (anything with advance() returning something that
+	 * tests true on acceptance, and finished() telling that it never will)
+	 * in turns, so that no single word holds up the others for long.
+	 *
+	 * Each turn advances one reader until the turn's step or time budget is
+	 * used up. The budget is only looked at between steps, so a turn runs
+	 * over by as much as one step takes: turns are only as short as the
+	 * steps of the readers, which ReadState keeps bounded (see its
+	 * closureWork). Readers take turns round-robin; with Policy::Priority a
+	 * reader only gets a turn when no reader of higher priority is waiting.
+	 *
+	 * Submitting, cancelling and querying may happen from any thread, also
+	 * while another thread is in runTurn(). Several threads may run turns
+	 * at once; a reader is never advanced by two of them at the same time.
+	 */
+public:
+	using Clock = std::chrono::steady_clock;
+	using Ticket = std::uint64_t;
+
+	enum class Policy
+	{
+		RoundRobin,
+		Priority
+	};
+
+	struct Budget
+	{
+		size_t steps = 64;
+		Clock::duration time = std::chrono::milliseconds(1);
+	};
+
+	struct Limits
+	{
+		int priority = 0;
+		std::optional<Clock::time_point> deadline = std::nullopt;
+		size_t maxSteps = SIZE_MAX;
+	};
+
+	// Called outside of the scheduler's lock whenever a reader finishes,
+	// with the reader as it was left.
+	std::function<void(Ticket, ReadOutcome, Reader const&)> onFinished{};
+
+private:
+	struct Job
+	{
+		std::optional<Reader> reader;
+		Limits limits;
+		std::atomic<size_t> steps{0};
+		ReadOutcome outcome = ReadOutcome::Pending;
+		std::atomic<bool> cancelled{false};
+
+		Job(Reader&& reader, Limits limits)
+		    : reader(std::move(reader)), limits(limits)
+		{
+		}
+	};
+
+	const Policy policy;
+	const Budget budget;
+
+	mutable std::mutex lock{};
+	std::unordered_map<Ticket, std::unique_ptr<Job>> jobs{};
+	// Waiting tickets by priority, highest first. Round-robin uses level 0.
+	std::map<int, std::deque<Ticket>, std::greater<int>> queue{};
+	size_t waiting = 0, running = 0;
+	Ticket nextTicket = 1;
+
+
+public:
+	explicit ReaderScheduler(Policy policy = Policy::RoundRobin,
+	                         Budget budget = {})
+	    : policy(policy), budget(budget)
+	{
+		if (budget.steps == 0)
+			throw std::invalid_argument("A turn must allow at least one step.");
+	}
+
+	ReaderScheduler(ReaderScheduler const&) = delete;
+
+	Ticket submit(Reader reader, Limits limits = {})
+	{
+		std::lock_guard<std::mutex> guard{lock};
+
+		Ticket ticket = nextTicket++;
+		jobs.emplace(ticket, std::make_unique<Job>(std::move(reader), limits));
+		queue[policy == Policy::Priority ? limits.priority : 0].push_back(ticket);
+		++waiting;
+		return ticket;
+	}
+
+	/*
+	 * Stops a reader: it is not advanced again and finishes as Cancelled at
+	 * its next turn, or after the current step if it is running.
+	 */
+	void cancel(Ticket ticket)
+	{
+		std::lock_guard<std::mutex> guard{lock};
+
+		auto found = jobs.find(ticket);
+		if (found != jobs.end()) found->second->cancelled = true;
+	}
+
+	ReadOutcome outcome(Ticket ticket) const
+	{
+		std::lock_guard<std::mutex> guard{lock};
+
+		auto found = jobs.find(ticket);
+		if (found == jobs.end())
+			throw std::out_of_range("Unknown or released reader ticket.");
+		return found->second->outcome;
+	}
+
+	size_t steps(Ticket ticket) const
+	{
+		std::lock_guard<std::mutex> guard{lock};
+
+		auto found = jobs.find(ticket);
+		if (found == jobs.end())
+			throw std::out_of_range("Unknown or released reader ticket.");
+		return found->second->steps;
+	}
+
+	// Forgets a finished reader's outcome.
+	void release(Ticket ticket)
+	{
+		std::lock_guard<std::mutex> guard{lock};
+
+		auto found = jobs.find(ticket);
+		if (found != jobs.end() && found->second->outcome != ReadOutcome::Pending)
+			jobs.erase(found);
+	}
+
+	// The number of readers that have not finished yet.
+	size_t pending() const
+	{
+		std::lock_guard<std::mutex> guard{lock};
+		return waiting + running;
+	}
+
+	/*
+	 * Gives one waiting reader its turn. Returns false if none was waiting.
+	 */
+	bool runTurn()
+	{
+		Ticket ticket;
+		Job* job;
+
+		{
+			std::lock_guard<std::mutex> guard{lock};
+			if (!waiting) return false;
+
+			auto level = queue.begin();
+			while (level->second.empty())
+				level = queue.erase(level);
+
+			ticket = level->second.front();
+			level->second.pop_front();
+			--waiting;
+			++running;
+			job = jobs.at(ticket).get();
+		}
+
+		ReadOutcome outcome = ReadOutcome::Pending;
+		std::optional<Reader> finished;
+		const auto started = Clock::now();
+
+		// A span per turn, not per step, keeps the trace small on long runs.
+		std::optional<TraceSpan> span{std::in_place, "ReaderScheduler turn"};
+		for (size_t step = 0; outcome == ReadOutcome::Pending; ++step) {
+			const auto now = Clock::now();
+
+			if (job->cancelled)
+				outcome = ReadOutcome::Cancelled;
+			else if (job->limits.deadline && now >= *job->limits.deadline)
+				outcome = ReadOutcome::Expired;
+			else if (job->steps >= job->limits.maxSteps)
+				outcome = ReadOutcome::Exhausted;
+			else if (step == budget.steps || now - started >= budget.time)
+				break;
+			else {
+				const bool accepted = static_cast<bool>(job->reader->advance());
+				++job->steps;
+
+				if (accepted)
+					outcome = ReadOutcome::Accepted;
+				else if (job->reader->finished())
+					outcome = ReadOutcome::Rejected;
+			}
+		}
+		span.reset();
+
+		{
+			std::lock_guard<std::mutex> guard{lock};
+			--running;
+
+			if (outcome == ReadOutcome::Pending) {
+				queue[policy == Policy::Priority ? job->limits.priority : 0]
+				    .push_back(ticket);
+				++waiting;
+				return true;
+			}
+
+			job->outcome = outcome;
+			finished.emplace(std::move(*job->reader));
+			job->reader.reset();
+		}
+
+		if (onFinished) onFinished(ticket, outcome, *finished);
+		return true;
+	}
+
+	// Runs turns until every reader has finished.
+	void run()
+	{
+		while (runTurn()) {
+		}
+	}
+
+	/*
+	 * Runs turns until every reader has finished or the time is up, so that
+	 * a caller can interleave the scheduling with other work.
+	 */
+	void runFor(Clock::duration time)
+	{
+		const auto until = Clock::now() + time;
+		while (Clock::now() < until && runTurn()) {
+		}
+	}
+};
+
+} // namespace context_free
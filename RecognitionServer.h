@@ -0,0 +1,476 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "CFParser.h"
+#include "CNFGrammar.h"
+#include "ChartRecognizer.h"
+#include "ResultCache.h"
+
+namespace context_free {
+
+/*
+ * Everything needed to answer membership queries for one grammar, built
+ * once from its text in the format of parseNamedGrammar().
+ */
+class CompiledGrammar
+{
+	static NamedGrammar parse(std::string const& text)
+	{
+		std::istringstream input{text};
+		return parseNamedGrammar(input);
+	}
+
+public:
+	const NamedGrammar source;
+	const IndexedGrammar indexed;
+	const CNFGrammar cnf;
+	const ChartRecognizer recognizer;
+
+private:
+	std::unordered_map<std::string, Symbol> terminalIds{};
+
+public:
+	explicit CompiledGrammar(std::string const& text)
+	    : source(parse(text)), indexed(indexGrammar(source)), cnf(toCNF(indexed)),
+	      recognizer(cnf)
+	{
+		for (size_t t = 0; t < indexed.terminals.size(); ++t)
+			terminalIds.emplace(
+			    static_cast<TokenChar const*>(indexed.terminals[t])->name,
+			    static_cast<Symbol>(t));
+	}
+
+	CompiledGrammar(CompiledGrammar const&) = delete;
+
+	// The word of the named terminals, or nothing if one is unknown.
+	std::optional<std::vector<Symbol>>
+	encode(std::vector<std::string> const& names) const
+	{
+		std::vector<Symbol> word;
+		word.reserve(names.size());
+		for (auto const& name : names) {
+			auto found = terminalIds.find(name);
+			if (found == terminalIds.end()) return std::nullopt;
+			word.push_back(found->second);
+		}
+		return word;
+	}
+};
+
+/*
+ * A grammar that is compiled by whoever asks for it first; everyone asking
+ * meanwhile waits for that.
+ */
+class PendingGrammar
+{
+	std::once_flag compiled{};
+	std::string text;
+	std::shared_ptr<const CompiledGrammar> grammar{};
+	std::exception_ptr error{};
+
+public:
+	explicit PendingGrammar(std::string text) : text(std::move(text)) {}
+
+	// Throws whatever compiling the grammar threw.
+	std::shared_ptr<const CompiledGrammar> get()
+	{
+		std::call_once(compiled, [this] {
+			try {
+				grammar = std::make_shared<const CompiledGrammar>(text);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			text = {};
+		});
+
+		if (error) std::rethrow_exception(error);
+		return grammar;
+	}
+};
+
+class GrammarCache
+{
+	/*
+	 * Grammars by the hash of their text, the least recently used evicted
+	 * beyond `capacity`. A grammar is compiled once however many clients
+	 * load it.
+	 */
+public:
+	using Entry = std::shared_ptr<PendingGrammar>;
+
+	static std::uint64_t keyOf(std::string const& text)
+	{
+		return StableHash{}.add(text).value();
+	}
+
+private:
+	const size_t capacity;
+
+	std::mutex lock{};
+	std::list<std::pair<std::uint64_t, Entry>> entries{}; // most recent first
+	std::unordered_map<std::uint64_t, decltype(entries)::iterator> byKey{};
+
+	void touch(decltype(entries)::iterator entry)
+	{
+		entries.splice(entries.begin(), entries, entry);
+	}
+
+public:
+	explicit GrammarCache(size_t capacity) : capacity(capacity)
+	{
+		if (capacity == 0)
+			throw std::invalid_argument("A grammar cache needs room for at "
+			                            "least one grammar.");
+	}
+
+	Entry load(std::string text)
+	{
+		const std::uint64_t key = keyOf(text);
+		std::lock_guard<std::mutex> guard{lock};
+
+		if (auto found = byKey.find(key); found != byKey.end()) {
+			touch(found->second);
+			return found->second->second;
+		}
+
+		auto entry = std::make_shared<PendingGrammar>(std::move(text));
+		entries.emplace_front(key, entry);
+		byKey[key] = entries.begin();
+		if (entries.size() > capacity) {
+			byKey.erase(entries.back().first);
+			entries.pop_back();
+		}
+
+		return entry;
+	}
+
+	std::optional<Entry> find(std::uint64_t key)
+	{
+		std::lock_guard<std::mutex> guard{lock};
+		auto found = byKey.find(key);
+		if (found == byKey.end()) return std::nullopt;
+		touch(found->second);
+		return found->second->second;
+	}
+};
+
+class RecognitionServer
+{
+	/*
+	 * Answers requests from any number of clients on a shared pool of worker
+	 * threads, keeping compiled grammars and answers across requests.
+	 *
+	 * Requests are lines; every one starts with a tag of the client's
+	 * choosing, which its response starts with as well:
+	 *
+	 *   <tag> load <n>            followed by n lines of grammar text
+	 *   <tag> recognize <grammar> <terminal>...
+	 *
+	 * A load is answered by "<tag> grammar <id>", where the id is the hash of
+	 * the text, so it can be used at once, even before the grammar is
+	 * compiled. A recognize is answered by "<tag> accepted" or
+	 * "<tag> rejected", and a bad request by "<tag> error <message>".
+	 * Responses come in the order they are ready, not the order of the
+	 * requests.
+	 */
+	struct Connection
+	{
+		std::ostream& out;
+		std::mutex lock{};
+		std::condition_variable idle{};
+		size_t pending = 0;
+	};
+
+	GrammarCache grammars;
+	ResultCache results;
+
+	std::mutex queueLock{};
+	std::condition_variable queueReady{};
+	std::deque<std::function<void()>> queue{};
+	bool stopping = false;
+	std::vector<std::thread> workers{};
+
+	void submit(Connection& connection, std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> guard{connection.lock};
+			++connection.pending;
+		}
+		{
+			std::lock_guard<std::mutex> guard{queueLock};
+			queue.push_back([&connection, job = std::move(job)] {
+				job();
+				std::lock_guard<std::mutex> guard{connection.lock};
+				if (--connection.pending == 0) connection.idle.notify_all();
+			});
+		}
+		queueReady.notify_one();
+	}
+
+	void work()
+	{
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> guard{queueLock};
+				queueReady.wait(guard, [this] { return stopping || !queue.empty(); });
+				if (queue.empty()) return;
+				job = std::move(queue.front());
+				queue.pop_front();
+			}
+			job();
+		}
+	}
+
+	static void respond(Connection& connection, std::string const& tag,
+	                    std::string const& response)
+	{
+		std::lock_guard<std::mutex> guard{connection.lock};
+		connection.out << tag << ' ' << response << '\n' << std::flush;
+	}
+
+	static std::string idOf(std::uint64_t key)
+	{
+		std::ostringstream id;
+		id << std::hex << std::setw(16) << std::setfill('0') << key;
+		return id.str();
+	}
+
+	void recognize(Connection& connection, std::string const& tag,
+	               GrammarCache::Entry const& entry, std::uint64_t key,
+	               std::vector<std::string> const& names)
+	{
+		std::shared_ptr<const CompiledGrammar> grammar;
+		try {
+			grammar = entry->get();
+		} catch (std::exception const& e) {
+			respond(connection, tag, std::string("error ") + e.what());
+			return;
+		}
+
+		auto word = grammar->encode(names);
+		if (!word) {
+			respond(connection, tag, "rejected");
+			return;
+		}
+
+		const CacheKey cacheKey{key, wordHash(grammar->indexed, *word)};
+		auto accepted = results.find(cacheKey);
+		if (!accepted) {
+			accepted = grammar->recognizer.recognize(std::move(*word));
+			results.insert(cacheKey, *accepted);
+		}
+		respond(connection, tag, *accepted ? "accepted" : "rejected");
+	}
+
+	void handle(Connection& connection, std::istream& in, std::string const& line)
+	{
+		std::istringstream request{line};
+		std::string tag, command;
+		if (!(request >> tag)) return; // a blank line
+		if (!(request >> command)) {
+			respond(connection, tag, "error missing command");
+			return;
+		}
+
+		if (command == "load") {
+			size_t lines = 0;
+			if (!(request >> lines)) {
+				respond(connection, tag, "error missing line count");
+				return;
+			}
+
+			std::string text, next;
+			for (size_t i = 0; i < lines && std::getline(in, next); ++i)
+				text += next + '\n';
+
+			const std::uint64_t key = GrammarCache::keyOf(text);
+			auto entry = grammars.load(std::move(text));
+			submit(connection, [&connection, tag, key, entry] {
+				try {
+					entry->get();
+					respond(connection, tag, "grammar " + idOf(key));
+				} catch (std::exception const& e) {
+					respond(connection, tag, std::string("error ") + e.what());
+				}
+			});
+		} else if (command == "recognize") {
+			std::string id;
+			std::uint64_t key = 0;
+			if (!(request >> id) || !(std::istringstream{id} >> std::hex >> key)) {
+				respond(connection, tag, "error missing grammar id");
+				return;
+			}
+
+			auto entry = grammars.find(key);
+			if (!entry) {
+				respond(connection, tag, "error unknown grammar " + id);
+				return;
+			}
+
+			std::vector<std::string> names;
+			for (std::string name; request >> name;)
+				names.push_back(name);
+
+			submit(connection, [this, &connection, tag, entry = *entry, key,
+			                    names = std::move(names)] {
+				recognize(connection, tag, entry, key, names);
+			});
+		} else {
+			respond(connection, tag, "error unknown command " + command);
+		}
+	}
+
+public:
+	explicit RecognitionServer(
+	    size_t threads = std::max(1u, std::thread::hardware_concurrency()),
+	    size_t grammarCapacity = 64, size_t resultCapacity = 1 << 16)
+	    : grammars(grammarCapacity), results(resultCapacity)
+	{
+		for (size_t i = 0; i < std::max<size_t>(1, threads); ++i)
+			workers.emplace_back([this] { work(); });
+	}
+
+	RecognitionServer(RecognitionServer const&) = delete;
+
+	~RecognitionServer()
+	{
+		{
+			std::lock_guard<std::mutex> guard{queueLock};
+			stopping = true;
+		}
+		queueReady.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	/*
+	 * Answers the requests of one client until its input ends and every
+	 * response is written. Any number of clients may be served at once.
+	 */
+	void serve(std::istream& in, std::ostream& out)
+	{
+		Connection connection{out};
+		for (std::string line; std::getline(in, line);)
+			handle(connection, in, line);
+
+		std::unique_lock<std::mutex> guard{connection.lock};
+		connection.idle.wait(guard, [&connection] { return !connection.pending; });
+	}
+};
+
+/*
+ * A stream buffer over a file descriptor, for serving clients of a socket.
+ */
+class DescriptorBuffer : public std::streambuf
+{
+	const int descriptor;
+	char input[4096], output[4096];
+
+protected:
+	int_type underflow() override
+	{
+		const ssize_t got = ::read(descriptor, input, sizeof input);
+		if (got <= 0) return traits_type::eof();
+		setg(input, input, input + got);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	int sync() override
+	{
+		for (char* from = pbase(); from < pptr();) {
+			const ssize_t written =
+			    ::write(descriptor, from, static_cast<size_t>(pptr() - from));
+			if (written <= 0) return -1;
+			from += written;
+		}
+		setp(output, output + sizeof output);
+		return 0;
+	}
+
+	int_type overflow(int_type c) override
+	{
+		if (sync() != 0) return traits_type::eof();
+		if (!traits_type::eq_int_type(c, traits_type::eof())) sputc(traits_type::to_char_type(c));
+		return traits_type::not_eof(c);
+	}
+
+public:
+	explicit DescriptorBuffer(int descriptor)
+	    : descriptor(descriptor), input(), output()
+	{
+		setp(output, output + sizeof output);
+	}
+
+	DescriptorBuffer(DescriptorBuffer const&) = delete;
+
+	~DescriptorBuffer() override
+	{
+		sync();
+		::close(descriptor);
+	}
+};
+
+/*
+ * Listens on a Unix domain socket at `path` and serves every client on a
+ * thread of its own. Returns only if the socket cannot be set up, by
+ * throwing std::runtime_error.
+ */
+[[noreturn]] inline void serveUnixSocket(RecognitionServer& server,
+                                         std::string const& path)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof address.sun_path)
+		throw std::runtime_error("The socket path is too long.");
+	path.copy(address.sun_path, path.size());
+
+	const int listening = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listening < 0) throw std::runtime_error("Couldn't create a socket.");
+
+	::unlink(path.c_str());
+	if (::bind(listening, reinterpret_cast<sockaddr const*>(&address),
+	           sizeof address) != 0 ||
+	    ::listen(listening, SOMAXCONN) != 0) {
+		::close(listening);
+		throw std::runtime_error("Couldn't listen on " + path + ".");
+	}
+
+	while (true) {
+		const int client = ::accept(listening, nullptr, nullptr);
+		if (client < 0) continue;
+
+		std::thread([&server, client] {
+			DescriptorBuffer buffer{client};
+			std::istream in{&buffer};
+			std::ostream out{&buffer};
+			server.serve(in, out);
+		}).detach();
+	}
+}
+
+} // namespace context_free
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class RegularApproximation
+{
+	/*
+	 * A finite automaton accepting a superset of a grammar's language, cheap
+	 * enough to run on every word before a context-free engine does. A word
+	 * it rejects is certainly not in the language; a word it accepts may
+	 * still be rejected by the real thing.
+	 *
+	 * The automaton is the product of three simple ones:
+	 *
+	 *  - the local (2-testable) approximation: which terminals may start and
+	 *    end a word and which may follow each other, with the state being
+	 *    the last terminal read,
+	 *  - a length counter modulo `modulus` together with the least length of
+	 *    a word in the language,
+	 *  - the parities of the counts of the first `paritySymbols` terminals.
+	 *
+	 * That already catches unbalanced lengths and letter counts, letters that
+	 * cannot occur and impossible neighbours, which is what most rejected
+	 * inputs trip over.
+	 */
+public:
+	// lcm(3, 4, 5): enough for the parities and small periods of typical
+	// grammars, and the residues fit in one 64-bit mask.
+	static constexpr size_t modulus = 60;
+
+	// 2^6 parity vectors fit in one 64-bit mask as well.
+	static constexpr size_t paritySymbols = 6;
+
+	const IndexedGrammar& grammar;
+
+private:
+	using Residues = std::uint64_t;
+	static constexpr Residues allResidues = (Residues{1} << modulus) - 1;
+
+	const size_t T;
+	bool emptyLanguage = true, acceptsEmpty = false;
+	size_t minLength = 0;
+	Residues lengths = 0;
+	Residues parities = 0;
+
+	std::vector<std::uint8_t> canStart{}, canEnd{};
+	std::vector<std::uint8_t> canFollow{}; // [previous * T + next]
+
+	std::unordered_map<const Char*, Symbol> terminalIds{};
+
+	static Residues shift(Residues set, size_t by)
+	{
+		by %= modulus;
+		if (!by) return set;
+		return ((set << by) | (set >> (modulus - by))) & allResidues;
+	}
+
+	static Residues add(Residues a, Residues b)
+	{
+		Residues sum = 0;
+		for (; a; a &= a - 1)
+			sum |= shift(b, static_cast<size_t>(__builtin_ctzll(a)));
+		return sum;
+	}
+
+	// The parity vectors of a concatenation of words from a and from b.
+	static Residues combineParities(Residues a, Residues b)
+	{
+		Residues sum = 0;
+		for (; a; a &= a - 1)
+			for (Residues rest = b; rest; rest &= rest - 1)
+				sum |= Residues{1} << (__builtin_ctzll(a) ^ __builtin_ctzll(rest));
+		return sum;
+	}
+
+	static size_t parityOf(Symbol terminal)
+	{
+		return terminal < paritySymbols ? size_t{1} << terminal : 0;
+	}
+
+public:
+	RegularApproximation(IndexedGrammar const& grammar)
+	    : grammar(grammar), T(grammar.terminals.size()), canStart(T, 0),
+	      canEnd(T, 0), canFollow(T * T, 0)
+	{
+		for (size_t t = 0; t < T; ++t)
+			terminalIds[grammar.terminals[t]] = static_cast<Symbol>(t);
+
+		const size_t N = grammar.nonterminals.size();
+		const auto& rules = grammar.rules;
+
+		// Lengths of the words each nonterminal derives: the residues and the
+		// least one. Nonterminals without any are not generating.
+		std::vector<Residues> residues(N, 0), parity(N, 0);
+		std::vector<size_t> shortest(N, SIZE_MAX);
+
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (auto const& rule : rules) {
+				Residues sum = 1, parities = 1;
+				size_t length = 0;
+				for (auto const& symbol : rule.to) {
+					if (symbol.terminal) {
+						sum = shift(sum, 1);
+						parities = combineParities(
+						    parities, Residues{1} << parityOf(symbol.id));
+						++length;
+					} else {
+						sum = add(sum, residues[symbol.id]);
+						parities = combineParities(parities, parity[symbol.id]);
+						length = shortest[symbol.id] == SIZE_MAX
+						             ? SIZE_MAX
+						             : std::min(SIZE_MAX - 1,
+						                        length + shortest[symbol.id]);
+					}
+					if (!sum) break;
+				}
+				if (!sum) continue;
+
+				if (sum & ~residues[rule.from]) {
+					residues[rule.from] |= sum;
+					changed = true;
+				}
+				if (parities & ~parity[rule.from]) {
+					parity[rule.from] |= parities;
+					changed = true;
+				}
+				if (length < shortest[rule.from]) {
+					shortest[rule.from] = length;
+					changed = true;
+				}
+			}
+		}
+
+		auto generating = [&](IndexedSymbol s) {
+			return s.terminal || residues[s.id] != 0;
+		};
+		auto usable = [&](IndexedRule const& rule) {
+			return std::all_of(rule.to.begin(), rule.to.end(), generating);
+		};
+
+		// Only rules reachable from the start and free of non-generating
+		// symbols can take part in a derivation.
+		std::vector<std::uint8_t> reachable(N, 0);
+		if (residues[grammar.start]) {
+			reachable[grammar.start] = 1;
+			for (bool changed = true; changed;) {
+				changed = false;
+				for (auto const& rule : rules) {
+					if (!reachable[rule.from] || !usable(rule)) continue;
+					for (auto const& symbol : rule.to)
+						if (!symbol.terminal && !reachable[symbol.id])
+							reachable[symbol.id] = changed = true;
+				}
+			}
+		}
+
+		std::vector<std::uint8_t> nullable(N, 0);
+		for (Symbol A = 0; A < N; ++A)
+			nullable[A] = residues[A] && shortest[A] == 0;
+
+		// first[A] and last[A] as T-sized rows.
+		std::vector<std::uint8_t> first(N * T, 0), last(N * T, 0);
+
+		auto unite = [&](std::vector<std::uint8_t>& into, size_t A,
+		                 IndexedSymbol from) {
+			bool changed = false;
+			if (from.terminal) {
+				changed = !into[A * T + from.id];
+				into[A * T + from.id] = 1;
+				return changed;
+			}
+			for (size_t t = 0; t < T; ++t)
+				if (into[from.id * T + t] && !into[A * T + t])
+					into[A * T + t] = changed = true;
+			return changed;
+		};
+
+		auto isNullable = [&](IndexedSymbol s) {
+			return !s.terminal && nullable[s.id];
+		};
+
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (auto const& rule : rules) {
+				if (!reachable[rule.from] || !usable(rule)) continue;
+
+				for (auto const& symbol : rule.to) {
+					changed |= unite(first, rule.from, symbol);
+					if (!isNullable(symbol)) break;
+				}
+				for (auto it = rule.to.rbegin(); it != rule.to.rend(); ++it) {
+					changed |= unite(last, rule.from, *it);
+					if (!isNullable(*it)) break;
+				}
+			}
+		}
+
+		auto row = [&](std::vector<std::uint8_t> const& table, IndexedSymbol s,
+		               size_t t) -> bool {
+			return s.terminal ? s.id == t : table[s.id * T + t];
+		};
+
+		for (auto const& rule : rules) {
+			if (!reachable[rule.from] || !usable(rule)) continue;
+
+			for (size_t i = 0; i < rule.to.size(); ++i)
+				for (size_t j = i + 1; j < rule.to.size(); ++j) {
+					for (size_t a = 0; a < T; ++a) {
+						if (!row(last, rule.to[i], a)) continue;
+						for (size_t b = 0; b < T; ++b)
+							if (row(first, rule.to[j], b)) canFollow[a * T + b] = 1;
+					}
+					if (!isNullable(rule.to[j])) break;
+				}
+		}
+
+		emptyLanguage = residues[grammar.start] == 0;
+		if (emptyLanguage) return;
+
+		acceptsEmpty = nullable[grammar.start];
+		minLength = shortest[grammar.start];
+		lengths = residues[grammar.start];
+		parities = parity[grammar.start];
+		for (size_t t = 0; t < T; ++t) {
+			canStart[t] = first[grammar.start * T + t];
+			canEnd[t] = last[grammar.start * T + t];
+		}
+	}
+
+	RegularApproximation(RegularApproximation const&) = delete;
+
+	/*
+	 * False if the word is certainly not in the language. Takes one pass
+	 * over the word.
+	 */
+	bool mayAccept(std::vector<Symbol> const& word) const
+	{
+		if (emptyLanguage) return false;
+		if (word.empty()) return acceptsEmpty;
+		if (word.size() < minLength) return false;
+		if (!((lengths >> (word.size() % modulus)) & 1)) return false;
+
+		size_t vector = 0;
+		for (Symbol t : word) {
+			if (t >= T) return false;
+			vector ^= parityOf(t);
+		}
+
+		if (!((parities >> vector) & 1)) return false;
+		if (!canStart[word.front()] || !canEnd[word.back()]) return false;
+
+		for (size_t i = 1; i < word.size(); ++i)
+			if (!canFollow[word[i - 1] * T + word[i]]) return false;
+
+		return true;
+	}
+
+	template <typename C> bool mayAccept(AlphaString<C> const& word) const
+	{
+		std::vector<Symbol> encoded;
+		encoded.reserve(word.string.size());
+
+		for (const C* c : word.string) {
+			auto found = terminalIds.find(c);
+			if (found == terminalIds.end()) return false;
+			encoded.push_back(found->second);
+		}
+
+		return mayAccept(encoded);
+	}
+};
+
+} // namespace context_free
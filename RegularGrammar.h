@@ -0,0 +1,404 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+class MinimalDfa
+{
+	/*
+	 * A minimal deterministic automaton over the terminal ids of a grammar,
+	 * with a dense transition table. State 0 is the dead state, if the
+	 * automaton has one. Reading a word takes one table lookup per char and
+	 * no memory beyond the table.
+	 */
+	size_t T = 0;
+	std::uint32_t start = 0;
+	bool hasDeadState = false;
+	std::vector<std::uint32_t> next{}; // [state * T + terminal]
+	std::vector<std::uint8_t> accepting{};
+	std::unordered_map<const Char*, Symbol> terminalIds{};
+
+	friend class RegularCompiler;
+
+public:
+	size_t states() const { return accepting.size(); }
+
+	bool recognize(std::vector<Symbol> const& word) const
+	{
+		std::uint32_t state = start;
+		for (Symbol t : word) {
+			state = next[state * T + t];
+			if (state == 0 && hasDeadState) return false;
+		}
+		return accepting[state];
+	}
+
+	template <typename C> bool recognize(AlphaString<C> const& word) const
+	{
+		std::uint32_t state = start;
+		for (const C* c : word.string) {
+			auto found = terminalIds.find(c);
+			if (found == terminalIds.end()) return false;
+			state = next[state * T + found->second];
+			if (state == 0 && hasDeadState) return false;
+		}
+		return accepting[state];
+	}
+};
+
+class RegularCompiler
+{
+	/*
+	 * Compiles a strongly regular grammar into a MinimalDfa, by the
+	 * construction of Mohri and Nederhof. A grammar is strongly regular if
+	 * the rules of every set of mutually recursive nonterminals are all
+	 * right-linear in that set (at most one symbol of the set, at the end) or
+	 * all left-linear in it (at most one, at the start). Right- and
+	 * left-linear grammars are the simplest such grammars; their languages
+	 * are exactly the regular ones.
+	 *
+	 * The grammar is turned into a nondeterministic automaton first, every
+	 * use of a nonterminal outside a recursive set getting its own copy of
+	 * that nonterminal's automaton, then determinized and minimized. Both
+	 * steps can blow up, so each gives up beyond `maxStates`.
+	 */
+	enum class Linearity { None, Right, Left };
+
+	IndexedGrammar const& grammar;
+	const size_t maxStates;
+
+	std::vector<std::uint32_t> component{}; // of each nonterminal
+	std::vector<std::vector<Symbol>> members{};
+	std::vector<Linearity> linearity{};
+	std::vector<std::uint8_t> recursive{};
+
+	// The nondeterministic automaton.
+	std::vector<std::vector<std::pair<Symbol, std::uint32_t>>> moves{};
+	std::vector<std::vector<std::uint32_t>> epsilon{};
+	bool tooBig = false;
+
+	std::uint32_t addState()
+	{
+		if (moves.size() >= maxStates) tooBig = true;
+		moves.emplace_back();
+		epsilon.emplace_back();
+		return static_cast<std::uint32_t>(moves.size() - 1);
+	}
+
+	// Tarjan's algorithm, iteratively, since grammars can be deep.
+	void findComponents()
+	{
+		const size_t N = grammar.nonterminals.size();
+		const std::uint32_t unvisited = UINT32_MAX;
+		std::vector<std::uint32_t> index(N, unvisited), low(N, 0);
+		std::vector<std::uint8_t> onStack(N, 0);
+		std::vector<Symbol> stack;
+		std::uint32_t counter = 0;
+		component.assign(N, 0);
+
+		// (nonterminal, next rule of it, next symbol of that rule)
+		std::vector<std::tuple<Symbol, size_t, size_t>> calls;
+		for (Symbol root = 0; root < N; ++root) {
+			if (index[root] != unvisited) continue;
+			calls.emplace_back(root, grammar.ruleOffsets[root], 0);
+			index[root] = low[root] = counter++;
+			stack.push_back(root);
+			onStack[root] = 1;
+
+			while (!calls.empty()) {
+				auto& [A, rule, position] = calls.back();
+				if (rule < grammar.ruleOffsets[A + 1]) {
+					auto const& to = grammar.rules[rule].to;
+					if (position == to.size()) {
+						++rule;
+						position = 0;
+						continue;
+					}
+					const IndexedSymbol symbol = to[position++];
+					if (symbol.terminal) continue;
+
+					const Symbol B = symbol.id;
+					if (index[B] == unvisited) {
+						index[B] = low[B] = counter++;
+						stack.push_back(B);
+						onStack[B] = 1;
+						calls.emplace_back(B, grammar.ruleOffsets[B], 0);
+					} else if (onStack[B]) {
+						low[A] = std::min(low[A], index[B]);
+					}
+					continue;
+				}
+
+				const Symbol done = A;
+				calls.pop_back();
+				if (!calls.empty()) {
+					const Symbol caller = std::get<0>(calls.back());
+					low[caller] = std::min(low[caller], low[done]);
+				}
+				if (low[done] != index[done]) continue;
+
+				members.emplace_back();
+				Symbol B;
+				do {
+					B = stack.back();
+					stack.pop_back();
+					onStack[B] = 0;
+					component[B] = static_cast<std::uint32_t>(members.size() - 1);
+					members.back().push_back(B);
+				} while (B != done);
+			}
+		}
+	}
+
+	// Whether every recursive set is right- or left-linear.
+	bool classify()
+	{
+		linearity.assign(members.size(), Linearity::None);
+		recursive.assign(members.size(), 0);
+
+		for (size_t M = 0; M < members.size(); ++M) {
+			bool right = true, left = true;
+			for (Symbol A : members[M])
+				for (auto const& rule : grammar.rulesOf(A)) {
+					size_t inside = 0;
+					for (auto const& symbol : rule.to)
+						if (!symbol.terminal && component[symbol.id] == M) ++inside;
+					if (inside == 0) continue;
+
+					recursive[M] = 1;
+					auto const& first = rule.to.front();
+					auto const& last = rule.to.back();
+					right &= inside == 1 && !last.terminal && component[last.id] == M;
+					left &= inside == 1 && !first.terminal && component[first.id] == M;
+				}
+
+			if (!recursive[M]) continue;
+			if (!right && !left) return false;
+			linearity[M] = right ? Linearity::Right : Linearity::Left;
+		}
+		return true;
+	}
+
+	void build(std::uint32_t from, IndexedSymbol const* begin,
+	           IndexedSymbol const* end, std::uint32_t to)
+	{
+		if (tooBig) return;
+
+		if (begin == end) {
+			epsilon[from].push_back(to);
+		} else if (end - begin > 1) {
+			const std::uint32_t middle = addState();
+			build(from, begin, begin + 1, middle);
+			build(middle, begin + 1, end, to);
+		} else if (begin->terminal) {
+			moves[from].emplace_back(begin->id, to);
+		} else {
+			buildNonterminal(from, begin->id, to);
+		}
+	}
+
+	void build(std::uint32_t from, std::vector<IndexedSymbol> const& symbols,
+	           std::uint32_t to)
+	{
+		build(from, symbols.data(), symbols.data() + symbols.size(), to);
+	}
+
+	void buildNonterminal(std::uint32_t from, Symbol A, std::uint32_t to)
+	{
+		const std::uint32_t M = component[A];
+		if (!recursive[M]) {
+			for (auto const& rule : grammar.rulesOf(A))
+				build(from, rule.to, to);
+			return;
+		}
+
+		// A state per member of the set: for right-linear sets, where the
+		// rest of the word has to be derived from it; for left-linear ones,
+		// where a prefix derived from it ends.
+		std::map<Symbol, std::uint32_t> stateOf;
+		for (Symbol B : members[M])
+			stateOf[B] = addState();
+		auto inside = [&](IndexedSymbol s) {
+			return !s.terminal && component[s.id] == M;
+		};
+
+		if (linearity[M] == Linearity::Right) {
+			epsilon[from].push_back(stateOf[A]);
+			for (Symbol B : members[M])
+				for (auto const& rule : grammar.rulesOf(B)) {
+					auto const& rhs = rule.to;
+					if (!rhs.empty() && inside(rhs.back()))
+						build(stateOf[B], rhs.data(), rhs.data() + rhs.size() - 1,
+						      stateOf[rhs.back().id]);
+					else
+						build(stateOf[B], rhs, to);
+				}
+		} else {
+			epsilon[stateOf[A]].push_back(to);
+			for (Symbol B : members[M])
+				for (auto const& rule : grammar.rulesOf(B)) {
+					auto const& rhs = rule.to;
+					if (!rhs.empty() && inside(rhs.front()))
+						build(stateOf[rhs.front().id], rhs.data() + 1,
+						      rhs.data() + rhs.size(), stateOf[B]);
+					else
+						build(from, rhs, stateOf[B]);
+				}
+		}
+	}
+
+	void close(std::vector<std::uint32_t>& states) const
+	{
+		std::vector<std::uint8_t> in(moves.size(), 0);
+		for (auto state : states)
+			in[state] = 1;
+		for (size_t i = 0; i < states.size(); ++i)
+			for (auto to : epsilon[states[i]])
+				if (!in[to]) {
+					in[to] = 1;
+					states.push_back(to);
+				}
+		std::sort(states.begin(), states.end());
+	}
+
+	std::optional<MinimalDfa> determinize(std::uint32_t initial,
+	                                      std::uint32_t final) const
+	{
+		const size_t T = grammar.terminals.size();
+		MinimalDfa dfa;
+		dfa.T = T;
+
+		std::map<std::vector<std::uint32_t>, std::uint32_t> ids{{{}, 0}};
+		std::vector<std::vector<std::uint32_t>> subsets{{}};
+		std::vector<std::uint32_t> start{initial};
+		close(start);
+		ids.emplace(start, 1);
+		subsets.push_back(std::move(start));
+
+		std::vector<std::vector<std::uint32_t>> targets(T);
+		for (size_t s = 0; s < subsets.size(); ++s) {
+			if (subsets.size() > maxStates) return std::nullopt;
+
+			for (auto& target : targets)
+				target.clear();
+			for (auto state : subsets[s])
+				for (auto [t, to] : moves[state])
+					targets[t].push_back(to);
+
+			dfa.accepting.push_back(std::binary_search(
+			    subsets[s].begin(), subsets[s].end(), final));
+			for (size_t t = 0; t < T; ++t) {
+				auto& target = targets[t];
+				close(target);
+				target.erase(std::unique(target.begin(), target.end()), target.end());
+				auto found =
+				    ids.emplace(target, static_cast<std::uint32_t>(subsets.size()));
+				if (found.second) subsets.push_back(target);
+				dfa.next.push_back(found.first->second);
+			}
+		}
+
+		dfa.start = 1;
+		return dfa;
+	}
+
+	// Moore's algorithm: split classes by their successors' classes until
+	// nothing splits any more.
+	static MinimalDfa minimize(MinimalDfa const& dfa)
+	{
+		const size_t n = dfa.states(), T = dfa.T;
+		std::vector<std::uint32_t> classOf(n);
+		for (size_t s = 0; s < n; ++s)
+			classOf[s] = dfa.accepting[s] != dfa.accepting[0];
+		size_t classes = 0;
+
+		while (true) {
+			std::map<std::vector<std::uint32_t>, std::uint32_t> split;
+			std::vector<std::uint32_t> refined(n);
+			std::vector<std::uint32_t> signature(T + 1);
+			for (size_t s = 0; s < n; ++s) {
+				signature[0] = classOf[s];
+				for (size_t t = 0; t < T; ++t)
+					signature[t + 1] = classOf[dfa.next[s * T + t]];
+				refined[s] = split.emplace(signature,
+				                           static_cast<std::uint32_t>(split.size()))
+				                 .first->second;
+			}
+			classOf = std::move(refined);
+			if (split.size() == classes) break;
+			classes = split.size();
+		}
+
+		// State 0 is first in its class, so the dead class stays 0.
+		MinimalDfa minimal;
+		minimal.T = T;
+		minimal.start = classOf[dfa.start];
+		minimal.hasDeadState = true;
+		minimal.accepting.assign(classes, 0);
+		minimal.next.assign(classes * T, 0);
+		for (size_t s = 0; s < n; ++s) {
+			minimal.accepting[classOf[s]] = dfa.accepting[s];
+			for (size_t t = 0; t < T; ++t)
+				minimal.next[classOf[s] * T + t] = classOf[dfa.next[s * T + t]];
+		}
+		return minimal;
+	}
+
+public:
+	RegularCompiler(IndexedGrammar const& grammar, size_t maxStates = 1 << 16)
+	    : grammar(grammar), maxStates(maxStates)
+	{
+		if (grammar.ruleOffsets.size() != grammar.nonterminals.size() + 1)
+			throw std::logic_error("The grammar's rules are not indexed; see "
+			                       "IndexedGrammar::indexRules().");
+		findComponents();
+	}
+
+	RegularCompiler(RegularCompiler const&) = delete;
+
+	bool stronglyRegular()
+	{
+		return classify();
+	}
+
+	/*
+	 * The minimal automaton of the grammar's language, or nothing if the
+	 * grammar is not strongly regular or the automaton got too big.
+	 */
+	std::optional<MinimalDfa> compile()
+	{
+		if (!classify()) return std::nullopt;
+
+		moves.clear();
+		epsilon.clear();
+		tooBig = false;
+		const std::uint32_t initial = addState(), final = addState();
+		buildNonterminal(initial, grammar.start, final);
+		if (tooBig) return std::nullopt;
+
+		auto dfa = determinize(initial, final);
+		if (!dfa) return std::nullopt;
+
+		MinimalDfa minimal = minimize(*dfa);
+		for (size_t t = 0; t < grammar.terminals.size(); ++t)
+			minimal.terminalIds[grammar.terminals[t]] = static_cast<Symbol>(t);
+		return minimal;
+	}
+};
+
+inline std::optional<MinimalDfa> compileRegular(IndexedGrammar const& grammar,
+                                                size_t maxStates = 1 << 16)
+{
+	return RegularCompiler{grammar, maxStates}.compile();
+}
+
+} // namespace context_free
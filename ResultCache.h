@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+/*
+ * Hashes that stay the same across builds and runs, unlike std::hash: FNV-1a
+ * followed by the SplitMix64 finalizer to spread the bits.
+ */
+class StableHash
+{
+	std::uint64_t state = 0xcbf29ce484222325;
+
+public:
+	StableHash& add(std::string const& bytes)
+	{
+		for (unsigned char c : bytes) {
+			state ^= c;
+			state *= 0x100000001b3;
+		}
+		// A terminator, so that ("ab", "c") and ("a", "bc") differ.
+		state ^= 0xff;
+		state *= 0x100000001b3;
+		return *this;
+	}
+
+	std::uint64_t value() const
+	{
+		std::uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+		return z ^ (z >> 31);
+	}
+};
+
+/*
+ * Identifies a grammar by its language-relevant content: the start symbol
+ * and the set of rules, written out with symbol names and sorted. Symbol
+ * ids, rule order, duplicate rules and weights make no difference.
+ */
+inline std::uint64_t grammarFingerprint(IndexedGrammar const& grammar)
+{
+	std::set<std::string> rules;
+	for (auto const& rule : grammar.rules) {
+		std::string line = grammar.nonterminals[rule.from] + " ->";
+		for (auto const& symbol : rule.to) {
+			line += symbol.terminal ? " t:" : " n:";
+			line += symbol.terminal ? charName(*grammar.terminals[symbol.id])
+			                        : grammar.nonterminals[symbol.id];
+		}
+		rules.insert(std::move(line));
+	}
+
+	StableHash hash;
+	hash.add(grammar.nonterminals[grammar.start]);
+	for (auto const& rule : rules)
+		hash.add(rule);
+	return hash.value();
+}
+
+template <typename C> std::uint64_t wordHash(AlphaString<C> const& word)
+{
+	StableHash hash;
+	for (const C* c : word.string)
+		hash.add(charName(*c));
+	return hash.value();
+}
+
+inline std::uint64_t wordHash(IndexedGrammar const& grammar,
+                              std::vector<Symbol> const& word)
+{
+	StableHash hash;
+	for (Symbol t : word)
+		hash.add(charName(*grammar.terminals.at(t)));
+	return hash.value();
+}
+
+struct CacheKey
+{
+	std::uint64_t grammar, word;
+
+	friend bool operator==(CacheKey a, CacheKey b)
+	{
+		return a.grammar == b.grammar && a.word == b.word;
+	}
+};
+
+class ResultCache
+{
+	/*
+	 * A bounded map from (grammar fingerprint, word hash) to the membership
+	 * answer, safe to share between threads. The entries are spread over
+	 * shards with a lock each, and every shard evicts with the CLOCK
+	 * algorithm.
+	 *
+	 * Entries are keyed by hashes only, so two different words collide with
+	 * probability about 2^-64 per pair.
+	 */
+	struct KeyHash
+	{
+		size_t operator()(CacheKey key) const
+		{
+			std::uint64_t z = key.word ^ (key.grammar * 0x9e3779b97f4a7c15);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+			return static_cast<size_t>(z ^ (z >> 31));
+		}
+	};
+
+	struct Entry
+	{
+		CacheKey key;
+		bool accepted = false;
+		bool referenced;
+	};
+
+	struct Shard
+	{
+		std::mutex lock{};
+		std::unordered_map<CacheKey, size_t, KeyHash> slots{};
+		std::vector<Entry> entries{};
+		size_t hand = 0;
+	};
+
+	const size_t perShard;
+	std::vector<std::unique_ptr<Shard>> shards{};
+
+	std::atomic<std::uint64_t> hits{0}, misses{0}, evictions{0};
+
+	Shard& shardOf(CacheKey key) const
+	{
+		return *shards[(KeyHash{}(key) >> 32) % shards.size()];
+	}
+
+public:
+	struct Statistics
+	{
+		std::uint64_t hits, misses, evictions;
+		size_t size;
+	};
+
+	explicit ResultCache(size_t capacity, size_t shardCount = 16)
+	    : perShard(std::max<size_t>(1, capacity / std::max<size_t>(1, shardCount)))
+	{
+		if (capacity == 0)
+			throw std::invalid_argument("A result cache needs room for at "
+			                            "least one entry.");
+
+		shardCount = std::max<size_t>(1, std::min(shardCount, capacity));
+		for (size_t i = 0; i < shardCount; ++i)
+			shards.push_back(std::make_unique<Shard>());
+	}
+
+	ResultCache(ResultCache const&) = delete;
+
+	std::optional<bool> find(CacheKey key)
+	{
+		Shard& shard = shardOf(key);
+		std::lock_guard<std::mutex> guard{shard.lock};
+
+		auto found = shard.slots.find(key);
+		if (found == shard.slots.end()) {
+			++misses;
+			return std::nullopt;
+		}
+
+		++hits;
+		Entry& entry = shard.entries[found->second];
+		entry.referenced = true;
+		return entry.accepted;
+	}
+
+	void insert(CacheKey key, bool accepted)
+	{
+		Shard& shard = shardOf(key);
+		std::lock_guard<std::mutex> guard{shard.lock};
+
+		auto found = shard.slots.find(key);
+		if (found != shard.slots.end()) {
+			shard.entries[found->second] = {key, accepted, true};
+			return;
+		}
+
+		if (shard.entries.size() < perShard) {
+			shard.slots[key] = shard.entries.size();
+			shard.entries.push_back({key, accepted, true});
+			return;
+		}
+
+		// Give every referenced entry a second chance, evict the first one
+		// that has used it up.
+		while (shard.entries[shard.hand].referenced) {
+			shard.entries[shard.hand].referenced = false;
+			shard.hand = (shard.hand + 1) % shard.entries.size();
+		}
+
+		Entry& victim = shard.entries[shard.hand];
+		shard.slots.erase(victim.key);
+		victim = {key, accepted, true};
+		shard.slots[key] = shard.hand;
+		shard.hand = (shard.hand + 1) % shard.entries.size();
+		++evictions;
+	}
+
+	/*
+	 * Returns the cached answer, or computes, stores and returns it. The
+	 * computation runs without holding any lock, so two threads may both
+	 * compute an answer that was missing.
+	 */
+	template <typename Compute> bool findOrCompute(CacheKey key, Compute&& compute)
+	{
+		if (auto cached = find(key)) return *cached;
+
+		bool accepted = compute();
+		insert(key, accepted);
+		return accepted;
+	}
+
+	Statistics statistics() const
+	{
+		size_t size = 0;
+		for (auto const& shard : shards) {
+			std::lock_guard<std::mutex> guard{shard->lock};
+			size += shard->entries.size();
+		}
+		return {hits.load(), misses.load(), evictions.load(), size};
+	}
+
+	/*
+	 * Writes all entries as text, one "grammar word accepted" line each, with
+	 * the hashes in hex. Fingerprints do not depend on the process, so the
+	 * entries can be loaded by a later run.
+	 */
+	void save(std::ostream& out) const
+	{
+		out << "context_free-result-cache 1\n";
+		for (auto const& shard : shards) {
+			std::lock_guard<std::mutex> guard{shard->lock};
+			for (auto const& entry : shard->entries)
+				out << std::hex << entry.key.grammar << ' ' << entry.key.word
+				    << std::dec << ' ' << entry.accepted << '\n';
+		}
+	}
+
+	/*
+	 * Returns the number of entries read. A file that is not a cache or has
+	 * a malformed entry throws runtime_error and adds nothing, so a
+	 * truncated file does not leave half of it behind.
+	 */
+	size_t load(std::istream& in)
+	{
+		std::string magic;
+		int version = 0;
+		if (!(in >> magic >> version) ||
+		    magic != "context_free-result-cache" || version != 1)
+			throw std::runtime_error("Not a result cache file.");
+
+		std::vector<std::pair<CacheKey, bool>> entries;
+		CacheKey key{};
+		bool accepted = false;
+		while (in >> std::hex >> key.grammar >> key.word >> std::dec >> accepted)
+			entries.emplace_back(key, accepted);
+
+		if (!in.eof())
+			throw std::runtime_error("Malformed entry in a result cache file.");
+
+		for (auto const& [read, wasAccepted] : entries)
+			insert(read, wasAccepted);
+		return entries.size();
+	}
+};
+
+} // namespace context_free
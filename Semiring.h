@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "BigUnsigned.h"
+#include "CNFGrammar.h"
+
+namespace context_free {
+
+/*
+ * The semirings a chart can be filled over. Each one provides
+ *
+ *  - value_type, zero() and one(),
+ *  - plus() for alternatives and times() for sequencing,
+ *  - isZero(), so that empty chart cells can be skipped,
+ *  - fromWeights(), which maps a CNF rule (or the empty word) to a value,
+ *  - selective, set when plus() always returns one of its arguments, which
+ *    is what allows reading a single best derivation back off the chart.
+ */
+
+struct BooleanSemiring
+{
+	using value_type = std::uint8_t;
+
+	static constexpr bool selective = true;
+
+	static value_type zero() { return 0; }
+	static value_type one() { return 1; }
+
+	static value_type plus(value_type a, value_type b) { return a | b; }
+	static value_type times(value_type a, value_type b) { return a & b; }
+
+	static bool isZero(value_type a) { return !a; }
+
+	static value_type fromWeights(Weights const& weights)
+	{
+		return weights.multiplicity != 0;
+	}
+};
+
+struct CountingSemiring
+{
+	/*
+	 * Counts derivations, saturating at 2^64 - 1.
+	 */
+	using value_type = std::uint64_t;
+
+	static constexpr bool selective = false;
+
+	static value_type zero() { return 0; }
+	static value_type one() { return 1; }
+
+	static value_type plus(value_type a, value_type b)
+	{
+		return saturatingAdd(a, b);
+	}
+
+	static value_type times(value_type a, value_type b)
+	{
+		return saturatingMul(a, b);
+	}
+
+	static bool isZero(value_type a) { return a == 0; }
+
+	static value_type fromWeights(Weights const& weights)
+	{
+		return weights.multiplicity;
+	}
+};
+
+struct ExactCountingSemiring
+{
+	using value_type = BigUnsigned;
+
+	static constexpr bool selective = false;
+
+	static value_type zero() { return {}; }
+	static value_type one() { return 1; }
+
+	static value_type plus(value_type const& a, value_type const& b)
+	{
+		return a + b;
+	}
+
+	static value_type times(value_type const& a, value_type const& b)
+	{
+		return a * b;
+	}
+
+	static bool isZero(value_type const& a) { return a.isZero(); }
+
+	static value_type fromWeights(Weights const& weights)
+	{
+		return weights.multiplicity;
+	}
+};
+
+/*
+ * The two probabilistic semirings work with log-probabilities in floats:
+ * products become sums and cannot underflow on long inputs.
+ */
+
+struct ViterbiSemiring
+{
+	/*
+	 * Max-product: the log-probability of the single best derivation.
+	 */
+	using value_type = float;
+
+	static constexpr bool selective = true;
+
+	static value_type zero()
+	{
+		return -std::numeric_limits<value_type>::infinity();
+	}
+	static value_type one() { return 0; }
+
+	static value_type plus(value_type a, value_type b) { return std::max(a, b); }
+	static value_type times(value_type a, value_type b) { return a + b; }
+
+	static bool isZero(value_type a) { return a < -std::numeric_limits<value_type>::max(); }
+
+	static value_type fromWeights(Weights const& weights)
+	{
+		return weights.multiplicity ? std::log(static_cast<value_type>(weights.bestWeight))
+		                            : zero();
+	}
+};
+
+struct InsideSemiring
+{
+	/*
+	 * Log-sum-exp: the log of the total probability of all derivations.
+	 */
+	using value_type = float;
+
+	static constexpr bool selective = false;
+
+	static value_type zero()
+	{
+		return -std::numeric_limits<value_type>::infinity();
+	}
+	static value_type one() { return 0; }
+
+	static value_type plus(value_type a, value_type b)
+	{
+		if (isZero(a)) return b;
+		if (isZero(b)) return a;
+
+		value_type high = std::max(a, b), low = std::min(a, b);
+		return high + std::log1p(std::exp(low - high));
+	}
+
+	static value_type times(value_type a, value_type b) { return a + b; }
+
+	static bool isZero(value_type a) { return a < -std::numeric_limits<value_type>::max(); }
+
+	static value_type fromWeights(Weights const& weights)
+	{
+		return weights.multiplicity ? std::log(static_cast<value_type>(weights.weight))
+		                            : zero();
+	}
+};
+
+} // namespace context_free
@@ -28,6 +28,8 @@ public:
 
 	bool empty() const { return stack.empty(); }
 
+	size_t size() const { return stack.size(); }
+
 	void push(C const& c)
 	{
 		CPtrBox inAlphabet = alphabet->findChar(c);
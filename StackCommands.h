@@ -1,15 +1,27 @@
 #pragma once
 
 #include <ostream>
+#include <vector>
 
 #include "Stack.h"
 
 namespace context_free {
 
+/*
+ * What a command does to a stack, for code that runs automata without Stack
+ * objects: pop `pops` chars, then push `pushes` in order.
+ */
+template <typename C> struct StackEffect
+{
+	size_t pops = 0;
+	std::vector<C> pushes{};
+};
+
 template <typename C, typename CPtrBox> struct StackCommand
 {
 	virtual void print(std::ostream&) const = 0;
 	virtual void execute(Stack<C, CPtrBox>& stack) const = 0;
+	virtual StackEffect<C> effect() const = 0;
 
 	virtual ~StackCommand() {}
 };
@@ -28,6 +40,8 @@ template <typename C, typename CPtrBox> struct Pop : StackCommand<C, CPtrBox>
 		stack.pop();
 	}
 
+	StackEffect<C> effect() const override { return {1, {}}; }
+
 	~Pop() {}
 };
 
@@ -37,6 +51,8 @@ template <typename C, typename CPtrBox> struct Sleep : StackCommand<C, CPtrBox>
 
 	void execute(Stack<C, CPtrBox>&) const override {}
 
+	StackEffect<C> effect() const override { return {}; }
+
 	~Sleep() {}
 };
 
@@ -55,6 +71,8 @@ template <typename C, typename CPtrBox> struct Push : StackCommand<C, CPtrBox>
 
 	void execute(Stack<C, CPtrBox>& stack) const override { stack.push(what); }
 
+	StackEffect<C> effect() const override { return {0, {what}}; }
+
 	~Push() {}
 };
 
@@ -111,7 +129,51 @@ struct Replace : StackCommand<C, CPtrBox>
 		}
 	}
 
+	StackEffect<C> effect() const override { return {1, {with}}; }
+
 	~Replace() {}
 };
 
+/*
+ * Replaces the top with a string of chars, the first of which ends up on top.
+ * With the empty string, that is a Pop.
+ */
+template <typename C, typename CPtrBox> struct Expand : StackCommand<C, CPtrBox>
+{
+	const std::vector<C> with;
+
+	Expand(std::vector<C> with) : with(std::move(with)) {}
+
+	void print(std::ostream& out) const override
+	{
+		out << "Expand<";
+		for (auto const& c : with)
+			c.print(out);
+		out << ">";
+	}
+
+	void execute(Stack<C, CPtrBox>& stack) const override
+	{
+		if (stack.empty())
+			throw std::runtime_error("Tried to expand the top of an empty stack!");
+
+		for (auto const& c : with)
+			if (!stack.alphabet->findChar(c))
+				throw std::runtime_error("Got an error while executing "
+				                         "Expand() command on the stack. "
+				                         "Stack left unchanged.");
+
+		stack.pop();
+		for (auto c = with.rbegin(); c != with.rend(); ++c)
+			stack.push(*c);
+	}
+
+	StackEffect<C> effect() const override
+	{
+		return {1, std::vector<C>(with.rbegin(), with.rend())};
+	}
+
+	~Expand() {}
+};
+
 } // namespace context_free
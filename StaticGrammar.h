@@ -0,0 +1,368 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "CFParser.h"
+
+namespace context_free {
+
+/*
+ * Grammars fixed at build time. A grammar is described by a type with three
+ * string constants, the rules in the format parseGrammar() reads:
+ *
+ *   struct Dyck
+ *   {
+ *       static constexpr const char* nonterminals = "S";
+ *       static constexpr const char* terminals = "ab";
+ *       static constexpr const char* rules = "S SaSbS S@";
+ *   };
+ *
+ * StaticRecognizer<Dyck> builds its tables from that at compile time, and
+ * StaticRecognizer<Dyck>::grammar() parses the very same text into the
+ * usual CFGrammarTouple for everything that works at run time.
+ */
+namespace static_grammar {
+
+using Mask = std::uint64_t;
+
+// Terminals, nonterminals and the helpers made up for long rules all share
+// the bits of one Mask.
+constexpr size_t maxSymbols = 64;
+constexpr size_t maxBinaryRules = 512;
+constexpr size_t maxUnitRules = 512;
+
+struct BinaryRule
+{
+	std::uint8_t from, left, right;
+};
+
+struct Tables
+{
+	size_t terminalCount = 0, symbolCount = 0;
+	std::uint8_t start = 0;
+	Mask nullable = 0;
+
+	// The symbol of each input char, or -1 for chars outside the alphabets.
+	std::int16_t symbolOf[256]{};
+
+	// closure[x] holds every A with A =>* x by unit steps, x itself included.
+	// Rules with a nullable symbol on one side count as unit rules.
+	Mask closure[maxSymbols]{};
+
+	BinaryRule binary[maxBinaryRules]{};
+	size_t binaryCount = 0;
+};
+
+constexpr bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+	       c == '\f';
+}
+
+constexpr Mask bit(size_t symbol) { return Mask{1} << symbol; }
+
+/*
+ * Brings the grammar into the form of Lange and Leiss: rules are binarized,
+ * but epsilon and unit rules stay and are taken care of by the closure.
+ */
+constexpr Tables compile(const char* terminals, const char* nonterminals,
+                         const char* rules)
+{
+	Tables tables{};
+	for (auto& symbol : tables.symbolOf)
+		symbol = -1;
+
+	auto declare = [&tables](char c) {
+		auto& symbol = tables.symbolOf[static_cast<unsigned char>(c)];
+		if (symbol != -1)
+			throw std::invalid_argument("A char is declared twice.");
+		if (tables.symbolCount == maxSymbols)
+			throw std::length_error("Too many symbols for a static grammar.");
+		symbol = static_cast<std::int16_t>(tables.symbolCount++);
+	};
+
+	for (const char* c = terminals; *c; ++c)
+		declare(*c);
+	tables.terminalCount = tables.symbolCount;
+	for (const char* c = nonterminals; *c; ++c)
+		declare(*c);
+
+	auto symbolOf = [&tables](char c) {
+		auto symbol = tables.symbolOf[static_cast<unsigned char>(c)];
+		if (symbol == -1)
+			throw std::invalid_argument("A rule uses an undeclared char.");
+		return static_cast<std::uint8_t>(symbol);
+	};
+
+	auto nonterminalOf = [&](char c) {
+		std::uint8_t symbol = symbolOf(c);
+		if (symbol < tables.terminalCount)
+			throw std::invalid_argument("A terminal is used as a nonterminal.");
+		return symbol;
+	};
+
+	std::uint8_t unitFrom[maxUnitRules]{}, unitTo[maxUnitRules]{};
+	size_t unitCount = 0;
+	Mask epsilon = 0;
+
+	auto addUnit = [&](std::uint8_t from, std::uint8_t to) {
+		if (unitCount == maxUnitRules)
+			throw std::length_error("Too many rules for a static grammar.");
+		unitFrom[unitCount] = from;
+		unitTo[unitCount++] = to;
+	};
+
+	auto addBinary = [&](std::uint8_t from, std::uint8_t left,
+	                     std::uint8_t right) {
+		if (tables.binaryCount == maxBinaryRules)
+			throw std::length_error("Too many rules for a static grammar.");
+		tables.binary[tables.binaryCount++] = {from, left, right};
+	};
+
+	const char* at = rules;
+	auto skipSpace = [&at] {
+		while (*at && isSpace(*at))
+			++at;
+	};
+
+	skipSpace();
+	if (!*at) throw std::invalid_argument("The grammar has no start char.");
+	tables.start = nonterminalOf(*at++);
+
+	for (skipSpace(); *at; skipSpace()) {
+		std::uint8_t from = nonterminalOf(*at++);
+		skipSpace();
+
+		const char* rhs = at;
+		while (*at && !isSpace(*at))
+			++at;
+		const size_t length = static_cast<size_t>(at - rhs);
+
+		if (length == 1 && *rhs == '@') {
+			epsilon |= bit(from);
+		} else if (length == 1) {
+			addUnit(from, symbolOf(rhs[0]));
+		} else {
+			for (size_t i = 0; i + 2 < length; ++i) {
+				if (tables.symbolCount == maxSymbols)
+					throw std::length_error(
+					    "Too many symbols for a static grammar.");
+				auto rest = static_cast<std::uint8_t>(tables.symbolCount++);
+				addBinary(from, symbolOf(rhs[i]), rest);
+				from = rest;
+			}
+			addBinary(from, symbolOf(rhs[length - 2]), symbolOf(rhs[length - 1]));
+		}
+
+		// Weights mean nothing to a recognizer.
+		skipSpace();
+		if (*at == '[') {
+			while (*at && *at != ']')
+				++at;
+			if (*at) ++at;
+		}
+	}
+
+	tables.nullable = epsilon;
+	for (bool changed = true; changed;) {
+		changed = false;
+		auto mark = [&](std::uint8_t symbol) {
+			if (!(tables.nullable & bit(symbol))) {
+				tables.nullable |= bit(symbol);
+				changed = true;
+			}
+		};
+
+		for (size_t r = 0; r < unitCount; ++r)
+			if (tables.nullable & bit(unitTo[r])) mark(unitFrom[r]);
+		for (size_t r = 0; r < tables.binaryCount; ++r) {
+			auto const& rule = tables.binary[r];
+			if ((tables.nullable & bit(rule.left)) &&
+			    (tables.nullable & bit(rule.right)))
+				mark(rule.from);
+		}
+	}
+
+	for (size_t r = 0; r < tables.binaryCount; ++r) {
+		auto const& rule = tables.binary[r];
+		if (tables.nullable & bit(rule.right)) addUnit(rule.from, rule.left);
+		if (tables.nullable & bit(rule.left)) addUnit(rule.from, rule.right);
+	}
+
+	for (size_t x = 0; x < tables.symbolCount; ++x) {
+		Mask& closure = tables.closure[x];
+		closure = bit(x);
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (size_t r = 0; r < unitCount; ++r)
+				if ((closure & bit(unitTo[r])) && !(closure & bit(unitFrom[r]))) {
+					closure |= bit(unitFrom[r]);
+					changed = true;
+				}
+		}
+	}
+
+	return tables;
+}
+
+} // namespace static_grammar
+
+template <typename Description> class StaticRecognizer
+{
+	/*
+	 * The bit-parallel CYK of ChartRecognizer over the compile-time tables:
+	 * per symbol, the spans it derives are kept as bitsets both by start and
+	 * by end, and the binary rules are unrolled into straight-line code.
+	 */
+	using Mask = static_grammar::Mask;
+	using Word = std::uint64_t;
+
+	static constexpr static_grammar::Tables tables = static_grammar::compile(
+	    Description::terminals, Description::nonterminals, Description::rules);
+
+	// Laid out as a BitChart: rows keep the words of the triangle i < j only.
+	struct Rows
+	{
+		const size_t lastWord;
+		std::vector<size_t> endRows, startRows;
+		std::vector<Word> ends{}, starts{};
+
+		Rows(size_t n) : lastWord(n / 64), endRows(n + 2, 0), startRows(n + 2, 0)
+		{
+			for (size_t i = 0; i <= n; ++i) {
+				endRows[i + 1] = endRows[i] + endsLength(i) * tables.symbolCount;
+				startRows[i + 1] = startRows[i] + startsLength(i) * tables.symbolCount;
+			}
+			ends.assign(endRows.back(), 0);
+			starts.assign(startRows.back(), 0);
+		}
+
+		size_t endsLength(size_t begin) const { return lastWord - begin / 64 + 1; }
+		size_t startsLength(size_t end) const { return end / 64 + 1; }
+
+		// Word w of the row is endsOf(x, begin)[w - begin / 64].
+		const Word* endsOf(size_t x, size_t begin) const
+		{
+			return ends.data() + endRows[begin] + x * endsLength(begin);
+		}
+
+		const Word* startsOf(size_t x, size_t end) const
+		{
+			return starts.data() + startRows[end] + x * startsLength(end);
+		}
+
+		void set(Mask symbols, size_t begin, size_t end)
+		{
+			for (; symbols; symbols &= symbols - 1) {
+				size_t x = static_cast<size_t>(__builtin_ctzll(symbols));
+				ends[endRows[begin] + x * endsLength(begin) + end / 64 - begin / 64] |=
+				    Word{1} << (end % 64);
+				starts[startRows[end] + x * startsLength(end) + begin / 64] |=
+				    Word{1} << (begin % 64);
+			}
+		}
+	};
+
+	template <size_t R>
+	static void apply(Rows const& rows, size_t begin, size_t end, Mask& derived)
+	{
+		constexpr auto rule = tables.binary[R];
+		if (derived & static_grammar::bit(rule.from)) return;
+
+		const Word* left = rows.endsOf(rule.left, begin);
+		const Word* right = rows.startsOf(rule.right, end);
+		const size_t first = (begin + 1) / 64, last = (end - 1) / 64;
+		const size_t offset = begin / 64;
+
+		for (size_t w = first; w <= last; ++w) {
+			Word splits = left[w - offset] & right[w];
+			if (w == first) splits &= ~Word{0} << ((begin + 1) % 64);
+			if (w == last) splits &= ~Word{0} >> (63 - (end - 1) % 64);
+			if (splits) {
+				derived |= static_grammar::bit(rule.from);
+				return;
+			}
+		}
+	}
+
+	template <size_t... R>
+	static Mask combine(Rows const& rows, size_t begin, size_t end,
+	                    std::index_sequence<R...>)
+	{
+		Mask derived = 0;
+		(apply<R>(rows, begin, end, derived), ...);
+		return derived;
+	}
+
+	static Mask close(Mask derived)
+	{
+		Mask closed = 0;
+		for (; derived; derived &= derived - 1)
+			closed |= tables.closure[__builtin_ctzll(derived)];
+		return closed;
+	}
+
+	template <typename Symbols> static bool run(size_t n, Symbols const& symbolAt)
+	{
+		if (n == 0) return tables.nullable & static_grammar::bit(tables.start);
+
+		Rows rows{n};
+
+		for (size_t i = 0; i < n; ++i) {
+			int symbol = symbolAt(i);
+			if (symbol < 0 || static_cast<size_t>(symbol) >= tables.terminalCount)
+				return false;
+			rows.set(tables.closure[symbol], i, i + 1);
+		}
+
+		for (size_t length = 2; length <= n; ++length)
+			for (size_t begin = 0; begin + length <= n; ++begin)
+				rows.set(close(combine(rows, begin, begin + length,
+				                       std::make_index_sequence<tables.binaryCount>{})),
+				         begin, begin + length);
+
+		auto const* whole = rows.endsOf(tables.start, 0);
+		return (whole[n / 64] >> (n % 64)) & 1;
+	}
+
+public:
+	static bool recognize(std::string_view word)
+	{
+		return run(word.size(), [word](size_t i) {
+			return tables.symbolOf[static_cast<unsigned char>(word[i])];
+		});
+	}
+
+	static bool recognize(AlphaString<LetterChar> const& word)
+	{
+		return run(word.string.size(), [&word](size_t i) {
+			return tables.symbolOf[static_cast<unsigned char>(
+			    word.string[i]->value)];
+		});
+	}
+
+	/*
+	 * The same grammar as a runtime CFGrammarTouple.
+	 */
+	static CFGrammarTouple<LetterChar, LetterChar> grammar()
+	{
+		auto alphabets =
+		    std::make_shared<AlphabetToupleDistinct<LetterChar, LetterChar>>(
+		        std::make_shared<Alphabet<LetterChar>>(
+		            std::string{Description::nonterminals}),
+		        std::make_shared<Alphabet<LetterChar>>(
+		            std::string{Description::terminals}));
+
+		std::istringstream rules{Description::rules};
+		return parseGrammar(rules, alphabets);
+	}
+};
+
+} // namespace context_free
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace context_free {
+
+struct TraceEvent
+{
+	const char* name;       // a string literal, as events outlive their spans
+	char phase;             // 'X' for a span, 'C' for a counter
+	std::uint64_t start;    // in ns since the tracer was created
+	std::uint64_t duration; // of a span
+	std::uint64_t series;   // of a counter, which gets a track of its own
+	std::int64_t value;     // of a counter
+};
+
+class Tracer
+{
+	/*
+	 * Collects spans and counters for the Chrome trace viewer
+	 * (chrome://tracing or Perfetto). Every thread records into a buffer of
+	 * its own; the lock is only taken for a thread's first event and for
+	 * the export. While tracing is off, a span or a counter costs a relaxed
+	 * load and a branch.
+	 */
+	using Clock = std::chrono::steady_clock;
+
+	struct Buffer
+	{
+		std::uint32_t thread;
+		std::vector<TraceEvent> events{};
+	};
+
+	std::atomic<bool> on{false};
+	std::atomic<std::uint64_t> nextSeries{1};
+	const Clock::time_point created = Clock::now();
+
+	std::mutex lock{};
+	// Kept here too, so that the events of finished threads are exported.
+	std::vector<std::shared_ptr<Buffer>> buffers{};
+
+	Tracer() = default;
+
+	Buffer& local()
+	{
+		thread_local std::shared_ptr<Buffer> buffer;
+		if (!buffer) {
+			std::lock_guard<std::mutex> guard{lock};
+			buffer = std::make_shared<Buffer>(
+			    Buffer{static_cast<std::uint32_t>(buffers.size()), {}});
+			buffers.push_back(buffer);
+		}
+		return *buffer;
+	}
+
+public:
+	static Tracer& instance()
+	{
+		static Tracer tracer;
+		return tracer;
+	}
+
+	Tracer(Tracer const&) = delete;
+	Tracer& operator=(Tracer const&) = delete;
+
+	bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+	void enable(bool enabled = true)
+	{
+		on.store(enabled, std::memory_order_relaxed);
+	}
+
+	std::uint64_t now() const
+	{
+		return static_cast<std::uint64_t>(
+		    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+		                                                         created)
+		        .count());
+	}
+
+	// A fresh series for counters, e.g. one per word read.
+	std::uint64_t series()
+	{
+		return nextSeries.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void record(TraceEvent const& event) { local().events.push_back(event); }
+
+	/*
+	 * Writes everything recorded so far as a Chrome trace. Threads that are
+	 * still recording must not be, for the time being.
+	 */
+	void write(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> guard{lock};
+
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (auto const& buffer : buffers)
+			for (auto const& event : buffer->events) {
+				out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+				    << "\",\"ph\":\"" << event.phase
+				    << "\",\"pid\":1,\"tid\":" << buffer->thread
+				    << ",\"ts\":" << static_cast<double>(event.start) / 1000;
+				if (event.phase == 'X')
+					out << ",\"dur\":" << static_cast<double>(event.duration) / 1000;
+				else
+					out << ",\"id\":" << event.series << ",\"args\":{\"value\":"
+					    << event.value << "}";
+				out << "}";
+				first = false;
+			}
+		out << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+	}
+};
+
+/*
+ * Records the time from its construction to its destruction as a span, if
+ * tracing was on when it was constructed.
+ */
+class TraceSpan
+{
+	const char* name;
+	const bool active;
+	std::uint64_t start = 0;
+
+public:
+	explicit TraceSpan(const char* name)
+	    : name(name), active(Tracer::instance().enabled())
+	{
+		if (active) start = Tracer::instance().now();
+	}
+
+	TraceSpan(TraceSpan const&) = delete;
+	TraceSpan& operator=(TraceSpan const&) = delete;
+
+	~TraceSpan()
+	{
+		if (!active) return;
+		auto& tracer = Tracer::instance();
+		tracer.record({name, 'X', start, tracer.now() - start, 0, 0});
+	}
+};
+
+/*
+ * Turns tracing on if given a path, and writes the trace there when
+ * destroyed, so that every way out of the scope leaves a trace behind.
+ */
+class TraceFile
+{
+	const char* const path;
+
+public:
+	explicit TraceFile(const char* path) : path(path)
+	{
+		if (path) Tracer::instance().enable();
+	}
+
+	TraceFile(TraceFile const&) = delete;
+	TraceFile& operator=(TraceFile const&) = delete;
+
+	~TraceFile()
+	{
+		if (!path) return;
+		std::ofstream out{path};
+		Tracer::instance().write(out);
+	}
+};
+
+inline void traceCounter(const char* name, std::uint64_t series, std::int64_t value)
+{
+	auto& tracer = Tracer::instance();
+	if (tracer.enabled()) tracer.record({name, 'C', tracer.now(), 0, series, value});
+}
+
+} // namespace context_free
@@ -0,0 +1,242 @@
+#include "AlphaString.h"
+#include "Ambiguity.h"
+#include "CFParser.h"
+#include "ChartRecognizer.h"
+#include "Lexer.h"
+#include "RecognitionServer.h"
+#include "StaticGrammar.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Checks StaticRecognizer against ChartRecognizer on the grammars below: all
+ * words up to a length, then a few long ones. Built with everything else, so
+ * that the compile-time tables of StaticGrammar.h are compiled on every
+ * build. Then checks the front ends on fixed inputs, where there is no
+ * second engine to compare with, and the ambiguity detector on a grammar
+ * whose counts are known, and the recognition server on requests from a
+ * string. "check.out" exits with 1 on the first
+ * failure.
+ */
+
+using namespace context_free;
+
+namespace {
+
+// The example of StaticGrammar.h.
+struct Dyck
+{
+	static constexpr const char* nonterminals = "S";
+	static constexpr const char* terminals = "ab";
+	static constexpr const char* rules = "S SaSbS S@";
+};
+
+struct Palindromes
+{
+	static constexpr const char* nonterminals = "SA";
+	static constexpr const char* terminals = "abc";
+	static constexpr const char* rules = "S SaSa SbSb Sc SA A@";
+};
+
+// Every word a^n has Catalan(n - 1) derivations: "aaa" is the shortest
+// ambiguous one, with 2.
+struct Sums
+{
+	static constexpr const char* nonterminals = "S";
+	static constexpr const char* terminals = "a";
+	static constexpr const char* rules = "S SSS Sa";
+};
+
+constexpr size_t allWordsUpTo = 10;
+
+template <typename Description> bool agrees(std::string const& word)
+{
+	static const auto grammar = StaticRecognizer<Description>::grammar();
+	static const auto cnf = toCNF(grammar);
+	static const ChartRecognizer chart{cnf};
+
+	auto parsed = AlphaString<LetterChar>::parseString(grammar.alphabets->T,
+	                                                   word.empty() ? "@" : word);
+	const bool expected = chart.recognize(cnf.encode(parsed));
+	if (StaticRecognizer<Description>::recognize(word) == expected &&
+	    StaticRecognizer<Description>::recognize(parsed) == expected)
+		return true;
+
+	std::cerr << "On \"" << word << "\" StaticRecognizer "
+	          << (expected ? "rejects" : "accepts")
+	          << " but ChartRecognizer does not." << std::endl;
+	return false;
+}
+
+template <typename Description> bool check()
+{
+	const std::string terminals = Description::terminals;
+
+	std::string word;
+	for (size_t length = 0; length <= allWordsUpTo; ++length) {
+		// Every word of this length, as a number in base |terminals|.
+		std::vector<size_t> digits(length, 0);
+		for (;;) {
+			word.clear();
+			for (size_t digit : digits)
+				word += terminals[digit];
+			if (!agrees<Description>(word)) return false;
+
+			size_t i = 0;
+			for (; i < length && ++digits[i] == terminals.size(); ++i)
+				digits[i] = 0;
+			if (i == length) break;
+		}
+	}
+
+	// Long enough for the rows of the chart to take several words.
+	for (size_t length : {63, 64, 65, 200, 1000}) {
+		word.assign(length, terminals[0]);
+		word += std::string(length, terminals[1]);
+		if (!agrees<Description>(word)) return false;
+		word.insert(length, std::string(1, terminals.back()));
+		if (!agrees<Description>(word)) return false;
+	}
+	return true;
+}
+
+bool fails(std::string const& what)
+{
+	std::cerr << what << std::endl;
+	return false;
+}
+
+/*
+ * Token definitions as a file holds them: the longest match wins, ties go
+ * to the earlier definition, whitespace is skipped, and a pattern matching
+ * the empty string is refused.
+ */
+bool checkLexer()
+{
+	auto terminals = std::make_shared<Alphabet<LetterChar>>("abc");
+	std::istringstream file{"a if\nb [a-z]+\nc ==?\n@ \\s+\n"};
+	const Lexer<LetterChar> lexer{terminals,
+	                              parseTokenDefinitions(file, *terminals)};
+
+	const std::string text = "if iffy == x";
+	auto tokens = lexer.tokens(text);
+	const std::vector<std::pair<size_t, size_t>> spans{{0, 2}, {3, 4}, {8, 2}, {11, 1}};
+	if (tokens.size() != spans.size())
+		return fails("The lexer splits \"" + text + "\" into " +
+		             std::to_string(tokens.size()) + " tokens.");
+	for (size_t i = 0; i < spans.size(); ++i)
+		if (tokens[i].begin != spans[i].first || tokens[i].length != spans[i].second)
+			return fails("The lexer gets token " + std::to_string(i) + " of \"" +
+			             text + "\" wrong.");
+
+	std::ostringstream word;
+	word << lexer.lex(text);
+	if (word.str() != "abcb")
+		return fails("The lexer reads \"" + text + "\" as " + word.str() + ".");
+
+	try {
+		lexer.tokens("if #");
+		return fails("The lexer splits text that no token matches.");
+	} catch (std::invalid_argument const&) {
+	}
+
+	try {
+		Lexer<LetterChar>{terminals, {{LetterChar{'a'}, "x*"}}};
+		return fails("The lexer takes a pattern matching the empty string.");
+	} catch (std::invalid_argument const&) {
+	}
+
+	return true;
+}
+
+bool checkAmbiguity()
+{
+	const auto grammar = StaticRecognizer<Sums>::grammar();
+	const auto cnf = toCNF(grammar);
+	AmbiguityDetector detector{cnf};
+
+	const std::vector<AmbiguityDetector::Count> catalan{0, 1, 1, 2, 5, 14, 42};
+	for (size_t length = 0; length < catalan.size(); ++length) {
+		const std::string word(length, 'a');
+		auto parsed = AlphaString<LetterChar>::parseString(grammar.alphabets->T,
+		                                                   word.empty() ? "@" : word);
+		const auto derivations = detector.derivations(cnf.encode(parsed));
+		if (derivations != catalan[length])
+			return fails("The ambiguity detector counts " +
+			             std::to_string(derivations) + " derivations of \"" +
+			             word + "\".");
+	}
+
+	auto found = detector.shortestAmbiguous(8);
+	if (found.size() != 1 || found.front().word.size() != 3 ||
+	    found.front().derivations != 2)
+		return fails("The ambiguity detector misses \"aaa\" as the shortest "
+		             "ambiguous word.");
+
+	std::ostringstream report;
+	detector.print(report, found.front());
+	if (report.str().find("\"aaa\"") == std::string::npos)
+		return fails("The ambiguity detector reports \"aaa\" as: " + report.str());
+	return true;
+}
+
+/*
+ * The responses of a server to the requests in `requests`, sorted, since
+ * they come in the order they are ready.
+ */
+std::vector<std::string> serve(RecognitionServer& server, std::string const& requests)
+{
+	std::istringstream in{requests};
+	std::ostringstream out;
+	server.serve(in, out);
+
+	std::istringstream written{out.str()};
+	std::vector<std::string> responses;
+	for (std::string line; std::getline(written, line);)
+		responses.push_back(line);
+	std::sort(responses.begin(), responses.end());
+	return responses;
+}
+
+bool checkServer()
+{
+	RecognitionServer server{2};
+
+	auto loaded = serve(server, "g load 3\nS\nS a S b\nS @\n");
+	const std::string prefix = "g grammar ";
+	if (loaded.size() != 1 || loaded.front().compare(0, prefix.size(), prefix))
+		return fails("The server loads a grammar with: " +
+		             (loaded.empty() ? "nothing" : loaded.front()));
+	const std::string id = loaded.front().substr(prefix.size());
+
+	const std::vector<std::string> expected{
+	    "1 accepted", "2 rejected", "3 rejected", "4 error unknown grammar 0123"};
+	auto responses = serve(server, "1 recognize " + id + " a a b b\n" +
+	                                   "2 recognize " + id + " a b b\n" +
+	                                   "3 recognize " + id + " a x b\n" +
+	                                   "4 recognize 0123 a b\n");
+	if (responses != expected) {
+		std::string got;
+		for (auto const& response : responses)
+			got += "\n  " + response;
+		return fails("The server responds:" + got);
+	}
+	return true;
+}
+
+} // namespace
+
+int main()
+{
+	if (!check<Dyck>() || !check<Palindromes>()) return 1;
+	std::cout << "StaticRecognizer agrees with ChartRecognizer." << std::endl;
+
+	if (!checkLexer() || !checkAmbiguity() || !checkServer()) return 1;
+	std::cout << "The front ends work." << std::endl;
+	return 0;
+}
@@ -0,0 +1,490 @@
+#include "AlphaString.h"
+#include "Ambiguity.h"
+#include "Automata.h"
+#include "CFGrammar.h"
+#include "CFParser.h"
+#include "ChartParser.h"
+#include "ChartRecognizer.h"
+#include "ErrorCorrection.h"
+#include "IncrementalRecognizer.h"
+#include "LanguageEnumeration.h"
+#include "LeftFactoring.h"
+#include "PDAlgorithms.h"
+#include "ParallelChart.h"
+#include "RegularApproximation.h"
+#include "RegularGrammar.h"
+#include "Semiring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Differential fuzzing of the recognizers: random small grammars and words go
+ * through every engine, and any two answers that disagree are reported with a
+ * minimized reproducer in the format main reads, then abort().
+ *
+ * The reference is the ReadState search of the grammar's automaton. It runs
+ * with a step and a memory bound, and where it runs out the CYK chart stands
+ * in for it. Every step of a search takes bounded work and memory, even where
+ * its epsilon closures grow exponentially, so every word and grammar is
+ * searched.
+ *
+ * Built as is, this is a standalone driver: "fuzz.out [cases] [seed]", which
+ * also fails a run of casesForEveryEngine cases or more in which some engine
+ * judged no word at all. With CONTEXT_FREE_LIBFUZZER defined it is a
+ * libFuzzer target instead; the input bytes are the choices the grammar and
+ * the words are made of.
+ */
+
+using namespace context_free;
+
+namespace {
+
+const std::string nonterminalChars = "SABC", terminalChars = "abc";
+
+// Search steps and cells for the automata readers before they count as
+// undecided.
+constexpr size_t maxSteps = 64;
+constexpr size_t memoryLimit = 1 << 16;
+
+// Small enough for some searches to fall back to iterative deepening.
+constexpr size_t tightMemory = 64;
+
+// The words of a grammar no correction may be further from than the one it
+// makes: all those up to this length.
+constexpr size_t maxEnumeratedLength = 5;
+
+// The words each engine has judged so far. Engines that only judge some
+// cases must still judge a few in a long run, or they go untested.
+std::map<std::string, std::uint64_t> judged;
+const char* const occasionalEngines[] = {
+    "the deterministic runner", "the minimal DFA", "the left-factored automaton",
+    "iterative deepening"};
+constexpr std::uint64_t casesForEveryEngine = 1000;
+
+/*
+ * The fuzzer's bytes as a series of choices. Once the bytes run out every
+ * choice is 0, so any input makes some case.
+ */
+class Choices
+{
+	const std::uint8_t* data;
+	size_t size;
+
+public:
+	Choices(const std::uint8_t* data, size_t size) : data(data), size(size) {}
+
+	size_t below(size_t bound)
+	{
+		if (!size) return 0;
+		--size;
+		return *data++ % bound;
+	}
+};
+
+/*
+ * A grammar in the text format of parseGrammar(), start symbol S, and the
+ * words to try on it.
+ */
+struct Case
+{
+	std::vector<std::string> rules{}; // each a nonterminal and its right-hand side
+	std::vector<std::string> words{};
+
+	std::string grammarText() const
+	{
+		std::string text = "S";
+		for (auto const& rule : rules)
+			text += " " + (rule.size() == 1 ? rule + "@" : rule);
+		return text;
+	}
+};
+
+Case generate(Choices& choices)
+{
+	const size_t nonterminals = 1 + choices.below(nonterminalChars.size());
+	const size_t terminals = 1 + choices.below(terminalChars.size());
+
+	Case generated;
+	const size_t ruleCount = 1 + choices.below(6);
+	for (size_t r = 0; r < ruleCount; ++r) {
+		std::string rule{nonterminalChars[choices.below(nonterminals)]};
+		const size_t length = choices.below(4);
+		for (size_t i = 0; i < length; ++i)
+			rule += choices.below(3) == 0
+			            ? nonterminalChars[choices.below(nonterminals)]
+			            : terminalChars[choices.below(terminals)];
+		generated.rules.push_back(std::move(rule));
+	}
+
+	const size_t wordCount = 1 + choices.below(4);
+	for (size_t w = 0; w < wordCount; ++w) {
+		std::string word;
+		const size_t length = choices.below(9);
+		for (size_t i = 0; i < length; ++i)
+			word += terminalChars[choices.below(terminals)];
+		generated.words.push_back(std::move(word));
+	}
+
+	return generated;
+}
+
+template <typename Automaton>
+std::optional<bool> search(Automaton const& automaton,
+                           AlphaString<LetterChar> const& word, size_t memoryLimit)
+{
+	auto reader =
+	    automaton.createReader(word, std::nullopt, BreadthFirst{}, memoryLimit);
+	for (size_t step = 0; step < maxSteps; ++step) {
+		if (reader.advance()) return true;
+		if (reader.finished()) return false;
+	}
+	return std::nullopt;
+}
+
+// The fewest insertions, deletions and substitutions from one word to the
+// other.
+size_t levenshtein(std::vector<Symbol> const& from, std::vector<Symbol> const& to)
+{
+	std::vector<size_t> row(to.size() + 1), next(to.size() + 1);
+	for (size_t j = 0; j <= to.size(); ++j)
+		row[j] = j;
+
+	for (size_t i = 0; i < from.size(); ++i) {
+		next[0] = i + 1;
+		for (size_t j = 0; j < to.size(); ++j)
+			next[j + 1] = std::min({row[j + 1] + 1, next[j] + 1,
+			                        row[j] + (from[i] == to[j] ? 0 : 1)});
+		std::swap(row, next);
+	}
+	return row[to.size()];
+}
+
+// Every word of the language of at most maxEnumeratedLength terminals.
+std::vector<std::vector<Symbol>> shortWords(CNFGrammar const& cnf,
+                                            ChartRecognizer const& chart)
+{
+	std::vector<std::vector<Symbol>> words, all{{}};
+	for (size_t begin = 0; begin < all.size(); ++begin) {
+		if (chart.recognize(all[begin])) words.push_back(all[begin]);
+		if (all[begin].size() == maxEnumeratedLength) continue;
+		for (Symbol t = 0; t < cnf.terminalCount(); ++t) {
+			all.push_back(all[begin]);
+			all.back().push_back(t);
+		}
+	}
+	return words;
+}
+
+/*
+ * What is wrong with the nearest word the corrector finds, if anything: it
+ * must be in the language, as many edits away as it says, and no nearer
+ * than any of `words`.
+ */
+std::optional<std::string> wrongCorrection(
+    std::vector<Symbol> const& word,
+    std::optional<LeastErrorsRecognizer::Correction> const& correction,
+    ChartRecognizer const& chart, std::vector<std::vector<Symbol>> const& words)
+{
+	if (!correction)
+		return words.empty() ? std::nullopt
+		                     : std::optional<std::string>{"finds no word"};
+
+	if (!chart.recognize(correction->word))
+		return "suggests a word outside of the language";
+
+	const size_t errors = levenshtein(word, correction->word);
+	if (errors != correction->errors)
+		return "counts " + std::to_string(correction->errors) +
+		       " edits to a word " + std::to_string(errors) + " edits away";
+
+	for (auto const& other : words)
+		if (levenshtein(word, other) < errors)
+			return "misses a word " + std::to_string(levenshtein(word, other)) +
+			       " edits away, finding one " + std::to_string(errors) +
+			       " edits away";
+	return std::nullopt;
+}
+
+/*
+ * What is wrong with the ambiguity detector on the short words, if anything:
+ * it must visit just the `words` of the language, count their derivations as
+ * the counting chart parser does, and report the shortest ambiguous ones.
+ */
+std::optional<std::string> wrongAmbiguity(
+    AmbiguityDetector& detector, ChartParser<CountingSemiring> const& counting,
+    std::vector<std::vector<Symbol>> const& words)
+{
+	size_t visited = 0;
+	std::optional<std::string> wrong;
+	detector.countWords(maxEnumeratedLength, [&](std::vector<Symbol> const& word,
+	                                             auto derivations, size_t&) {
+		++visited;
+		const auto expected = counting.total(word);
+		if (!wrong && derivations != expected)
+			wrong = "counts " + std::to_string(derivations) +
+			        " derivations of a word with " + std::to_string(expected);
+	});
+	if (wrong) return wrong;
+	if (visited != words.size())
+		return "visits " + std::to_string(visited) + " words of the " +
+		       std::to_string(words.size()) + " short enough";
+
+	size_t shortest = SIZE_MAX;
+	for (auto const& word : words)
+		if (counting.total(word) > 1) shortest = std::min(shortest, word.size());
+
+	auto found = detector.shortestAmbiguous(maxEnumeratedLength);
+	if (found.empty() != (shortest == SIZE_MAX))
+		return found.empty() ? "finds no ambiguous word"
+		                     : "finds an ambiguous word where there is none";
+	for (auto const& ambiguous : found)
+		if (ambiguous.word.size() != shortest ||
+		    ambiguous.derivations != counting.total(ambiguous.word))
+			return "reports a word of " + std::to_string(ambiguous.word.size()) +
+			       " terminals with " + std::to_string(ambiguous.derivations) +
+			       " derivations as a shortest ambiguous one";
+	return std::nullopt;
+}
+
+std::string describe(std::optional<bool> verdict)
+{
+	return verdict ? *verdict ? "accepts" : "rejects" : "undecided";
+}
+
+// Whether the automaton, which is not deterministic, gets a
+// DeterministicRunner anyway.
+template <typename AutomataT> bool runsAnyway(AutomataT const& automata)
+{
+	try {
+		automata.createDeterministicRunner();
+		return true;
+	} catch (std::logic_error const&) {
+		return false;
+	}
+}
+
+/*
+ * What is wrong with the case, if anything: the first engine that disagrees,
+ * and on which word.
+ */
+std::optional<std::string> disagreement(Case const& tested)
+{
+	try {
+		auto alphabets = std::make_shared<AlphabetToupleDistinct<LetterChar, LetterChar>>(
+		    std::make_shared<Alphabet<LetterChar>>(nonterminalChars),
+		    std::make_shared<Alphabet<LetterChar>>(terminalChars));
+		std::istringstream text{tested.grammarText()};
+		auto grammar = parseGrammar(text, alphabets);
+
+		auto automata = grammarToAutomata(grammar);
+		auto leftFactored = leftFactor(grammar);
+		auto factored = grammarToAutomata(leftFactored);
+		std::optional<decltype(automata.createDeterministicRunner())> runner;
+		if (automata.deterministic())
+			runner.emplace(automata.createDeterministicRunner());
+		else if (runsAnyway(automata))
+			return std::string{"The deterministic runner takes an automaton it "
+			                   "cannot run."};
+
+		auto indexed = indexGrammar(grammar);
+		auto cnf = toCNF(indexed);
+		const ChartRecognizer chart{cnf};
+		const ChartParser<BooleanSemiring> booleanParser{cnf};
+		const ChartParser<CountingSemiring> countingParser{cnf};
+		const LeastErrorsRecognizer corrector{cnf};
+		const RegularApproximation prefilter{indexed};
+		auto dfa = compileRegular(indexed);
+		const auto languageWords = shortWords(cnf, chart);
+		AmbiguityDetector detector{cnf};
+		if (auto wrong = wrongAmbiguity(detector, countingParser, languageWords))
+			return "The ambiguity detector " + *wrong + ".";
+
+		for (auto const& text : tested.words) {
+			auto word = AlphaString<LetterChar>::parseString(
+			    alphabets->T, text.empty() ? "@" : text);
+			auto symbols = cnf.encode(word);
+
+			const auto reference = search(automata, word, memoryLimit);
+			const bool expected = reference.value_or(chart.recognize(symbols));
+
+			std::vector<std::pair<std::string, std::optional<bool>>> verdicts{
+			    {"the chart recognizer", chart.recognize(symbols)},
+			    {"the boolean chart parser", booleanParser.total(symbols) != 0},
+			    {"the counting chart parser", countingParser.total(symbols) != 0},
+			    {"the parallel chart parser",
+			     symbols.empty() ? booleanParser.total(symbols) != 0
+			                     : booleanParser.total(parseParallel(
+			                           booleanParser, symbols, 2)) != 0},
+			    {"the least-errors recognizer",
+			     corrector.correct(symbols, 0).has_value()},
+			};
+			verdicts.emplace_back("the left-factored automaton",
+			                      search(factored, word, memoryLimit));
+			verdicts.emplace_back("iterative deepening",
+			                      search(automata, word, tightMemory));
+			if (runner)
+				verdicts.emplace_back("the deterministic runner", runner->recognize(word));
+			if (dfa) verdicts.emplace_back("the minimal DFA", dfa->recognize(symbols));
+
+			IncrementalRecognizer fresh{indexed, symbols};
+			verdicts.emplace_back("the incremental recognizer", fresh.accepted());
+
+			// The same word, reached by editing the reversed one.
+			IncrementalRecognizer edited{
+			    indexed, std::vector<Symbol>(symbols.rbegin(), symbols.rend())};
+			edited.replace(0, symbols.size() / 2,
+			               std::vector<Symbol>(symbols.begin(),
+			                                   symbols.begin() +
+			                                       static_cast<std::ptrdiff_t>(
+			                                           symbols.size() / 2)));
+			edited.replace(symbols.size() / 2, symbols.size() - symbols.size() / 2,
+			               std::vector<Symbol>(symbols.begin() +
+			                                       static_cast<std::ptrdiff_t>(
+			                                           symbols.size() / 2),
+			                                   symbols.end()));
+			verdicts.emplace_back("the edited incremental recognizer",
+			                      edited.accepted());
+
+			for (auto const& [engine, verdict] : verdicts) {
+				if (!verdict) continue;
+				++judged[engine];
+				if (*verdict != expected)
+					return "On \"" + text + "\" " + engine + " " +
+					       describe(verdict) + " but the reference " +
+					       describe(expected) + ".";
+			}
+
+			if (expected && !prefilter.mayAccept(symbols))
+				return "The regular approximation rejects \"" + text +
+				       "\", which is accepted.";
+
+			if (detector.derivations(symbols) != countingParser.total(symbols))
+				return "On \"" + text + "\" the ambiguity detector counts " +
+				       std::to_string(detector.derivations(symbols)) +
+				       " derivations, the counting chart parser " +
+				       std::to_string(countingParser.total(symbols)) + ".";
+
+			if (auto wrong = wrongCorrection(symbols, corrector.correct(symbols),
+			                                 chart, languageWords))
+				return "On \"" + text + "\" the least-errors recognizer " +
+				       *wrong + ".";
+		}
+	} catch (std::exception const& e) {
+		return std::string{"An engine threw: "} + e.what();
+	}
+
+	return std::nullopt;
+}
+
+/*
+ * The failing case cut down by dropping words, rules, and symbols from
+ * either, for as long as it keeps failing.
+ */
+Case minimized(Case failing)
+{
+	auto attempt = [&failing](Case candidate) {
+		if (!disagreement(candidate)) return false;
+		failing = std::move(candidate);
+		return true;
+	};
+
+	for (bool shrunk = true; shrunk;) {
+		shrunk = false;
+
+		for (size_t i = 0; i < failing.words.size(); ++i) {
+			Case candidate = failing;
+			candidate.words.erase(candidate.words.begin() + static_cast<std::ptrdiff_t>(i));
+			if (!candidate.words.empty() && attempt(std::move(candidate)))
+				shrunk = true, --i;
+		}
+
+		for (size_t i = 0; i < failing.rules.size(); ++i) {
+			Case candidate = failing;
+			candidate.rules.erase(candidate.rules.begin() + static_cast<std::ptrdiff_t>(i));
+			if (attempt(std::move(candidate))) shrunk = true, --i;
+		}
+
+		// The first char of a rule is its left-hand side, which stays.
+		for (size_t r = 0; r < failing.rules.size(); ++r)
+			for (size_t i = 1; i < failing.rules[r].size(); ++i) {
+				Case candidate = failing;
+				candidate.rules[r].erase(i, 1);
+				if (attempt(std::move(candidate))) shrunk = true, --i;
+			}
+
+		for (size_t w = 0; w < failing.words.size(); ++w)
+			for (size_t i = 0; i < failing.words[w].size(); ++i) {
+				Case candidate = failing;
+				candidate.words[w].erase(i, 1);
+				if (attempt(std::move(candidate))) shrunk = true, --i;
+			}
+	}
+
+	return failing;
+}
+
+void check(Case const& tested)
+{
+	if (!disagreement(tested)) return;
+
+	Case reproducer = minimized(tested);
+	std::cerr << *disagreement(reproducer) << std::endl
+	          << "Reproducer, as main reads it:" << std::endl
+	          << reproducer.grammarText() << std::endl
+	          << "x" << std::endl;
+	for (auto const& word : reproducer.words)
+		std::cerr << (word.empty() ? "@" : word) << " " << maxSteps << std::endl;
+	std::abort();
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, size_t size)
+{
+	Choices choices{data, size};
+	check(generate(choices));
+	return 0;
+}
+
+#ifndef CONTEXT_FREE_LIBFUZZER
+int main(int argc, char** argv)
+{
+	const std::uint64_t cases = argc > 1 ? std::stoull(argv[1]) : 100000;
+	SplitMix64 random{argc > 2 ? std::stoull(argv[2]) : 1};
+
+	const auto started = std::chrono::steady_clock::now();
+	std::vector<std::uint8_t> bytes(64);
+	for (std::uint64_t i = 0; i < cases; ++i) {
+		for (auto& byte : bytes)
+			byte = static_cast<std::uint8_t>(random());
+		LLVMFuzzerTestOneInput(bytes.data(), bytes.size());
+	}
+
+	const std::chrono::duration<double> elapsed =
+	    std::chrono::steady_clock::now() - started;
+	std::cout << cases << " cases agreed, "
+	          << static_cast<double>(cases) / elapsed.count() * 3600
+	          << " cases per hour." << std::endl;
+
+	if (cases < casesForEveryEngine) return 0;
+	for (const char* engine : occasionalEngines) {
+		std::cout << "Words judged by " << engine << ": " << judged[engine]
+		          << std::endl;
+		if (!judged[engine]) {
+			std::cerr << "No word was judged by " << engine << "." << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+#endif
@@ -1,10 +1,26 @@
 #include "AlphaString.h"
+#include "Ambiguity.h"
 #include "Automata.h"
 #include "CFGrammar.h"
 #include "CFParser.h"
+#include "ErrorCorrection.h"
+#include "LeftFactoring.h"
+#include "Lexer.h"
 #include "PDAlgorithms.h"
+#include "ReaderScheduler.h"
+#include "RecognitionServer.h"
+#include "RegularApproximation.h"
+#include "RegularGrammar.h"
+#include "ResultCache.h"
+#include "Tracing.h"
 
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
 
 using namespace context_free;
 
@@ -35,8 +51,30 @@ auto createMeatBalls()
 	return meatBalls;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	// A Chrome trace of the run goes to the file CONTEXT_FREE_TRACE names,
+	// on any return from main. A server on a socket only stops when killed,
+	// and leaves none.
+	const TraceFile trace{std::getenv("CONTEXT_FREE_TRACE")};
+
+	// "--serve" answers requests until killed, from the Unix domain socket
+	// given next or else from stdin; see RecognitionServer.
+	if (argc > 1 && std::string{argv[1]} == "--serve") {
+		RecognitionServer server;
+		if (argc > 2) {
+			try {
+				serveUnixSocket(server, argv[2]);
+			} catch (std::runtime_error const& e) {
+				std::cerr << "Couldn't serve on " << argv[2] << ": " << e.what()
+				          << std::endl;
+				return 1;
+			}
+		}
+		server.serve(std::cin, std::cout);
+		return 0;
+	}
+
 	std::string terminals = "abc",
 	            variables = "SABC";
 
@@ -45,8 +83,47 @@ int main()
 	    std::make_shared<AlphabetToupleDistinct<LetterChar, LetterChar>>(
 	        toSharedAlphabet(variables), toSharedAlphabet(terminals)));
 
+	// "--ambiguity [n]" reports the shortest ambiguous words of at most n
+	// chars, 8 by default, and nothing else.
+	if (argc > 1 && std::string{argv[1]} == "--ambiguity") {
+		const size_t maxLength = argc > 2 ? std::stoul(argv[2]) : 8;
+		const auto cnf = toCNF(grammar);
+		if (cnf.countsSaturated)
+			std::cout << "Some words have infinitely many derivations." << std::endl;
+
+		AmbiguityDetector detector{cnf};
+		auto found = detector.shortestAmbiguous(maxLength);
+		if (found.empty())
+			std::cout << "No word of at most " << maxLength
+			          << " chars is ambiguous." << std::endl;
+		for (auto const& ambiguous : found)
+			detector.print(std::cout, ambiguous);
+		return 0;
+	}
+
 	auto& alphabets = grammar.alphabets;
 
+	// "--tokens file" splits every word into tokens by the definitions in
+	// the file, one per line as parseTokenDefinitions() reads them. A word
+	// is then a line: the step count, whitespace and the text to lex. The
+	// arguments after the file are those of a plain run.
+	std::optional<Lexer<LetterChar>> lexer;
+	if (argc > 2 && std::string{argv[1]} == "--tokens") {
+		std::ifstream definitions{argv[2]};
+		try {
+			if (!definitions)
+				throw std::runtime_error("the file cannot be opened");
+			lexer.emplace(alphabets->T,
+			              parseTokenDefinitions(definitions, *alphabets->T));
+		} catch (std::exception const& e) {
+			std::cerr << "Couldn't read the token definitions " << argv[2]
+			          << ": " << e.what() << std::endl;
+			return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
 	std::cout << "Non-termianls: " << *alphabets->N << std::endl;
 	std::cout << "Termianls: " << *alphabets->T << std::endl;
 
@@ -55,7 +132,10 @@ int main()
 		          << rule.to << std::endl;
 	}
 
-	auto automata = grammarToAutomata(grammar);
+	// Rules sharing a prefix are factored first, so that the automaton only
+	// forks where they differ.
+	auto factored = leftFactor(grammar);
+	auto automata = grammarToAutomata(factored);
 
 	std::cout << "Start: " << automata.start.human_name << std::endl;
 
@@ -64,24 +144,172 @@ int main()
 		s.printTransitions(std::cout);
 	}
 
-	while (!streamFinished(std::cin)) {
-		auto word = parseString(std::cin, alphabets->T);
-		auto reader = automata.createReader(word);
+	std::optional<decltype(automata.createDeterministicRunner())> runner;
+	if (automata.deterministic()) {
+		std::cout << "The automaton is deterministic." << std::endl;
+		// Epsilon paths too long to compose are left to ReadState.
+		try {
+			runner.emplace(automata.createDeterministicRunner());
+		} catch (std::logic_error const& e) {
+			std::cerr << "Reading without the deterministic runner: " << e.what()
+			          << std::endl;
+		}
+	}
+
+	auto indexed = indexGrammar(grammar);
+	RegularApproximation prefilter{indexed};
+
+	auto dfa = compileRegular(indexed);
+	if (dfa)
+		std::cout << "The grammar is regular, with a minimal automaton of "
+		          << dfa->states() << " states." << std::endl;
 
+	// Rejected words come with the nearest word of the language, if there is
+	// one within a few edits.
+	const auto cnf = toCNF(indexed);
+	const LeastErrorsRecognizer corrector{cnf};
+	const size_t maxCorrections = 8;
+	auto rejected = [&](std::ostream& out, AlphaString<LetterChar> const& word) {
+		out << "Word \"" << word << "\" not recognized." << std::endl;
+
+		// No errors means the search gave up before it found the word.
+		auto correction = corrector.correct(cnf.encode(word), maxCorrections);
+		if (!correction || correction->errors == 0) return;
+		out << "Nearest word: \"";
+		cnf.printWord(out, correction->word);
+		out << "\", " << correction->errors << " edit(s) away." << std::endl;
+	};
+
+	// Answers come out in the order of the words, however long each takes:
+	// an answer waits until those of all earlier words are out.
+	std::map<size_t, std::string> waiting;
+	size_t asked = 0, answered = 0;
+	auto print = [&](size_t index, std::string output) {
+		waiting.emplace(index, std::move(output));
+		for (auto next = waiting.begin();
+		     next != waiting.end() && next->first == answered;
+		     next = waiting.erase(next), ++answered)
+			std::cout << next->second << std::flush;
+	};
+	auto answer = [&](size_t index, AlphaString<LetterChar> const& word,
+	                  bool accepted) {
+		std::ostringstream out;
+		if (accepted)
+			out << "WORD \"" << word << "\" RECOGNIZED!" << std::endl;
+		else
+			rejected(out, word);
+		print(index, out.str());
+	};
+
+	// Recognized words are remembered, in the file given as the first
+	// argument if there is one. Misses are not: the search below is bounded,
+	// so "not found" is no final answer.
+	ResultCache cache{1 << 16};
+	const std::uint64_t fingerprint = grammarFingerprint(indexed);
+	if (argc > 1) {
+		std::ifstream saved{argv[1]};
+		try {
+			if (saved) cache.load(saved);
+		} catch (std::runtime_error const& e) {
+			std::cerr << "Ignoring the result cache " << argv[1] << ": "
+			          << e.what() << std::endl;
+		}
+	}
+
+	// Words are read while earlier ones are still being searched: every
+	// reader gets n steps in total, handed out in short turns, and at most
+	// memoryLimit stack cells before it falls back to iterative deepening.
+	const size_t memoryLimit = 1 << 20;
+	using Reader = decltype(
+	    automata.createReader(std::declval<AlphaString<LetterChar> const&>()));
+	ReaderScheduler<Reader> scheduler;
+	std::unordered_map<ReaderScheduler<Reader>::Ticket,
+	                   std::tuple<AlphaString<LetterChar>, CacheKey, size_t>>
+	    inFlight;
+
+	scheduler.onFinished = [&](auto ticket, ReadOutcome outcome,
+	                           Reader const& reader) {
+		auto const& [word, key, index] = inFlight.at(ticket);
+
+		if (outcome == ReadOutcome::Accepted) cache.insert(key, true);
+		answer(index, word, outcome == ReadOutcome::Accepted);
+
+		const bool decided = outcome == ReadOutcome::Accepted ||
+		                     outcome == ReadOutcome::Rejected;
+		if (decided && reader.mode() != SearchMode::Frontier)
+			std::cerr << "Word \"" << word << "\" ran out of memory for the "
+			          << "frontier and was decided by " << toString(reader.mode())
+			          << "." << std::endl;
+
+		inFlight.erase(ticket);
+		scheduler.release(ticket);
+	};
+
+	while (!streamFinished(std::cin)) {
+		std::optional<AlphaString<LetterChar>> read;
 		int n = 0;
-		bool found = false;
-		if (!(std::cin >> n)) break;
-		for (int i = 0; i < n; ++i) {
-			const auto result = reader.advance();
-
-			if (result) {
-				found = true;
-				std::cout << "WORD \"" << word << "\" RECOGNIZED!" << std::endl;
+		size_t index = 0;
+
+		if (lexer) {
+			std::string text;
+			if (!(std::cin >> n) || !std::getline(std::cin, text)) break;
+			text.erase(0, text.find_first_not_of(" \t"));
+			index = asked++;
+
+			try {
+				read.emplace(lexer->lex(text));
+			} catch (std::invalid_argument const& e) {
+				print(index, "Text \"" + text + "\" not split into tokens: " +
+				                 e.what() + "\n");
+				continue;
 			}
+		} else {
+			read.emplace(parseString(std::cin, alphabets->T));
+			if (!(std::cin >> n)) break;
+			index = asked++;
+		}
+		auto const& word = *read;
+
+		// Most rejected words never need to reach the automaton.
+		if (!prefilter.mayAccept(word)) {
+			answer(index, word, false);
+			continue;
+		}
+
+		const CacheKey key{fingerprint, wordHash(word)};
+		if (cache.find(key).value_or(false)) {
+			answer(index, word, true);
+			continue;
+		}
+
+		// A regular grammar or a deterministic automaton decides at once,
+		// with no search at all.
+		if (dfa || runner) {
+			const bool accepted = dfa ? dfa->recognize(word) : runner->recognize(word);
+			if (accepted) cache.insert(key, true);
+			answer(index, word, accepted);
+			continue;
 		}
 
-		if (!found)
-			std::cout << "Word \"" << word << "\" not recognized." << std::endl;
+		ReaderScheduler<Reader>::Limits limits;
+		limits.maxSteps = static_cast<size_t>(std::max(n, 0));
+		auto ticket = scheduler.submit(
+		    automata.createReader(word, std::nullopt, BreadthFirst{}, memoryLimit),
+		    limits);
+		inFlight.emplace(ticket, std::make_tuple(word, key, index));
+
+		scheduler.runFor(std::chrono::milliseconds(1));
+	}
+
+	scheduler.run();
+
+	auto statistics = cache.statistics();
+	std::cerr << "Result cache: " << statistics.hits << " hits, "
+	          << statistics.misses << " misses." << std::endl;
+
+	if (argc > 1) {
+		std::ofstream saved{argv[1]};
+		cache.save(saved);
 	}
 
 	std::cout << "Bye!" << std::endl;